@@ -0,0 +1,70 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "meminfo.h"
+
+// The buffer cache grows past NBUF blocks: a file several times
+// that size, once read, reads again without a single miss.
+
+#define NBLOCK 1024
+
+char buf[BSIZE];
+
+void
+fail(char *msg)
+{
+  printf(1, "bcachetest: %s failed\n", msg);
+  unlink("bcachetest.tmp");
+  exit();
+}
+
+// Read the whole file; returns the misses it took.
+int
+readall(void)
+{
+  struct meminfo mi;
+  int fd, i, misses;
+
+  if(meminfo(&mi, 0, 0) < 0)
+    fail("meminfo");
+  misses = mi.bufmisses;
+  if((fd = open("bcachetest.tmp", O_RDONLY)) < 0)
+    fail("open");
+  for(i = 0; i < NBLOCK; i++)
+    if(read(fd, buf, BSIZE) != BSIZE || buf[0] != (char)i)
+      fail("read");
+  close(fd);
+  if(meminfo(&mi, 0, 0) < 0)
+    fail("meminfo");
+  return mi.bufmisses - misses;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct meminfo mi;
+  int fd, i, misses;
+
+  if((fd = open("bcachetest.tmp", O_CREATE|O_RDWR)) < 0)
+    fail("create");
+  for(i = 0; i < NBLOCK; i++){
+    memset(buf, i, BSIZE);
+    if(write(fd, buf, BSIZE) != BSIZE)
+      fail("write");
+  }
+  close(fd);
+
+  misses = readall();
+  printf(1, "first read: %d misses\n", misses);
+  if((misses = readall()) != 0)
+    fail("second read");
+  if(meminfo(&mi, 0, 0) < 0 || mi.nbuf < NBLOCK)
+    fail("cache size");
+  printf(1, "second read: 0 misses, %d KB cached, %d hits %d misses: ok\n",
+         mi.nbuf*BSIZE/1024, mi.bufhits, mi.bufmisses);
+  unlink("bcachetest.tmp");
+  exit();
+}
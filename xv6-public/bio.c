@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -17,42 +17,285 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// The cache grows a group of NGBUF buffers at a time, to NBUF
+// blocks as soon as it needs them (enough for the log to pin two
+// full transactions) and past that into free memory, for as long
+// as more than 1/BUFRESERVE of memory is free.  When memory runs
+// short, swapalloc() calls bshrink() to give whole groups back
+// before it swaps out user pages.
+//
+// Replacement is 2Q (Johnson and Shasha, VLDB '94), so that one
+// pass over a big file does not push out the blocks in regular
+// use.  A block read for the first time goes on the FIFO queue
+// A1in.  If it is evicted from there and read again while the
+// ghost table still remembers it, it goes on the main queue Am
+// instead.  Am is replaced by CLOCK: a hit only sets b->ref, so
+// hits never touch the shared queues.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "meminfo.h"
 
-struct {
+#define NBUCKET    13
+#define NGBUF      32                      // buffers in a group
+#define NGPAGE     (NGBUF*BSIZE/PGSIZE)    // data pages of a group
+#define NMINGROUP  ((NBUF+NGBUF-1)/NGBUF)  // groups never given back
+#define NGHOST     8192                    // ghost table entries
+#define BUFRESERVE 16
+
+// A group of buffers.  The group lives in one page and its
+// blocks' data in NGPAGE more.
+struct bufgroup {
+  struct bufgroup *next;
+  char *data[NGPAGE];
+  struct buf buf[NGBUF];
+};
+
+// Buffers are hashed by block into buckets, each with its own
+// lock, so lookups of different blocks do not contend.
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *head;            // chained through b->hnext
+  uint hits;
+};
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
+// A block recently evicted from A1in.
+struct ghost {
+  uint dev;
+  uint blockno;
+  uint seq;                    // bcache.nevict when it was evicted
+};
+
+// bcache.lock protects the queues, the groups and the ghost
+// table, and serializes misses, so only the one holding it ever
+// holds two bucket locks.  A bucket lock protects its hash chain
+// and the refcnt of the buffers on it.
+struct {
+  struct spinlock lock;
+  struct bucket bucket[NBUCKET];
+  struct buf queue[3];         // list heads, indexed by BQ_
+  int nqueue[3];
+  struct bufgroup *groups;
+  int ngroup;
+  struct ghost ghost[NGHOST];
+  uint nevict;                 // evictions from A1in
+  uint misses;
+  int nasync;                  // prefetches in flight
 } bcache;
 
+static struct bucket*
+bhash(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev * 31 + blockno) % NBUCKET];
+}
+
+static struct ghost*
+ghash(uint dev, uint blockno)
+{
+  return &bcache.ghost[(dev * 31 + blockno) % NGHOST];
+}
+
+// Take b off its queue.  Caller holds bcache.lock.
+static void
+qremove(struct buf *b)
+{
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+  bcache.nqueue[b->queue]--;
+}
+
+// Put b at the head of queue q.  Caller holds bcache.lock.
+static void
+qpush(int q, struct buf *b)
+{
+  struct buf *h;
+
+  h = &bcache.queue[q];
+  b->next = h->next;
+  b->prev = h;
+  h->next->prev = b;
+  h->next = b;
+  b->queue = q;
+  bcache.nqueue[q]++;
+}
+
+// Add a group of buffers to the free queue.  Caller holds
+// bcache.lock.  Returns 0 on success.
+static int
+bgrow(void)
+{
+  struct bufgroup *g;
+  struct buf *b;
+  int i;
+
+  if((g = (struct bufgroup*)kalloc(KM_BUF)) == 0)
+    return -1;
+  memset(g, 0, sizeof(*g));
+  for(i = 0; i < NGPAGE; i++){
+    if((g->data[i] = kalloc(KM_BUF)) == 0){
+      while(--i >= 0)
+        kfree(g->data[i]);
+      kfree((char*)g);
+      return -1;
+    }
+  }
+  for(i = 0; i < NGBUF; i++){
+    b = &g->buf[i];
+    initsleeplock(&b->lock, "buffer");
+    b->data = (uchar*)g->data[i/(PGSIZE/BSIZE)] + (i%(PGSIZE/BSIZE))*BSIZE;
+    qpush(BQ_FREE, b);
+  }
+  g->next = bcache.groups;
+  bcache.groups = g;
+  bcache.ngroup++;
+  return 0;
+}
+
+// Whether the cache may take more memory.
+static int
+bcangrow(void)
+{
+  struct meminfo mi;
+
+  kmeminfo(&mi);
+  return mi.free > mi.total / BUFRESERVE;
+}
+
 void
 binit(void)
 {
-  struct buf *b;
+  struct bucket *k;
+  int i;
 
+  if(sizeof(struct bufgroup) > PGSIZE)
+    panic("binit: bufgroup");
   initlock(&bcache.lock, "bcache");
 
 //PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  for(k = bcache.bucket; k < bcache.bucket+NBUCKET; k++)
+    initlock(&k->lock, "bcache.bucket");
+  for(i = 0; i < NELEM(bcache.queue); i++){
+    bcache.queue[i].prev = &bcache.queue[i];
+    bcache.queue[i].next = &bcache.queue[i];
+  }
+  // Only boot memory is there yet; bget() does the rest.
+  if(bgrow() < 0)
+    panic("binit: out of memory");
+}
+
+// The buffer for block blockno of dev in bucket k, or 0.
+// Caller holds k->lock.
+static struct buf*
+bfind(struct bucket *k, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = k->head; b != 0; b = b->hnext)
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+  return 0;
+}
+
+// Take b out of the cache if nobody is using it.  Even if
+// refcnt==0, B_DIRTY indicates a buffer is in use because log.c
+// has modified it but not yet committed it.  Caller holds
+// bcache.lock and, if k is not 0, the lock of bucket k.
+// Returns 1 if b was taken out.
+static int
+bunhash(struct buf *b, struct bucket *k)
+{
+  struct bucket *o;
+  struct buf **pb;
+  int ok;
+
+  o = bhash(b->dev, b->blockno);
+  if(o != k)
+    acquire(&o->lock);
+  ok = b->refcnt == 0 && (b->flags & B_DIRTY) == 0;
+  if(ok){
+    for(pb = &o->head; *pb != b; pb = &(*pb)->hnext)
+      ;
+    *pb = b->hnext;
   }
+  if(o != k)
+    release(&o->lock);
+  return ok;
+}
+
+// Evict the oldest idle block of A1in, remembering it in the
+// ghost table.
+static struct buf*
+evictin(struct bucket *k)
+{
+  struct buf *b;
+  struct ghost *g;
+
+  for(b = bcache.queue[BQ_IN].prev; b != &bcache.queue[BQ_IN]; b = b->prev){
+    if(!bunhash(b, k))
+      continue;
+    g = ghash(b->dev, b->blockno);
+    g->dev = b->dev;
+    g->blockno = b->blockno;
+    g->seq = bcache.nevict++;
+    qremove(b);
+    return b;
+  }
+  return 0;
+}
+
+// Evict from Am by CLOCK: blocks hit since the hand last passed
+// get a second chance at the head of the queue.
+static struct buf*
+evictmain(struct bucket *k)
+{
+  struct buf *b;
+  int i, n;
+
+  n = bcache.nqueue[BQ_MAIN];
+  for(i = 0; i < 2*n; i++){
+    b = bcache.queue[BQ_MAIN].prev;
+    qremove(b);
+    if(!b->ref && bunhash(b, k))
+      return b;
+    b->ref = 0;
+    qpush(BQ_MAIN, b);
+  }
+  return 0;
+}
+
+// Evict a block to free its buffer, which is returned off every
+// list, or 0 if every buffer is in use.  Caller holds bcache.lock
+// and k->lock.
+static struct buf*
+bevict(struct bucket *k)
+{
+  struct buf *b;
+
+  // A1in keeps a quarter of the cache.
+  if(bcache.nqueue[BQ_IN] > bcache.ngroup*NGBUF/4 && (b = evictin(k)) != 0)
+    return b;
+  if((b = evictmain(k)) != 0)
+    return b;
+  return evictin(k);
+}
+
+// Whether the ghost table says block blockno was evicted from
+// A1in recently, within the last half cache's worth of evictions.
+static int
+ghosted(uint dev, uint blockno)
+{
+  struct ghost *g;
+
+  g = ghash(dev, blockno);
+  return g->dev == dev && g->blockno == blockno &&
+         bcache.nevict - g->seq <= bcache.ngroup*NGBUF/2;
 }
 
 // Look through buffer cache for block on device dev.
@@ -61,35 +304,59 @@ binit(void)
 static struct buf*
 bget(uint dev, uint blockno)
 {
+  struct bucket *k;
   struct buf *b;
 
-  acquire(&bcache.lock);
+  k = bhash(dev, blockno);
+  acquire(&k->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  if((b = bfind(k, dev, blockno)) != 0){
+    b->refcnt++;
+    b->ref = 1;
+    k->hits++;
+    release(&k->lock);
+    acquiresleep(&b->lock);
+    return b;
   }
+  release(&k->lock);
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  // Not cached.  Look again once misses are serialized, since
+  // another miss on the same block may have got in first.
+  acquire(&bcache.lock);
+  acquire(&k->lock);
+  if((b = bfind(k, dev, blockno)) != 0){
+    b->refcnt++;
+    b->ref = 1;
+    k->hits++;
+    release(&k->lock);
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    return b;
   }
-  panic("bget: no buffers");
+  bcache.misses++;
+
+  // Take a free buffer, growing the cache if memory allows,
+  // or else evict a block.
+  if(bcache.nqueue[BQ_FREE] == 0 && (bcache.ngroup < NMINGROUP || bcangrow()))
+    bgrow();
+  if(bcache.nqueue[BQ_FREE] > 0){
+    b = bcache.queue[BQ_FREE].next;
+    qremove(b);
+  } else if((b = bevict(k)) == 0)
+    panic("bget: no buffers");
+  b->dev = dev;
+  b->blockno = blockno;
+  b->flags = 0;
+  b->refcnt = 1;
+  b->ref = 0;
+  qpush(ghosted(dev, blockno) ? BQ_MAIN : BQ_IN, b);
+  b->hnext = k->head;
+  k->head = b;
+  release(&k->lock);
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -105,6 +372,18 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Like bread(), for a block whose old contents do not matter:
+// never reads the disk.  Caller must fill in all of b->data.
+struct buf*
+bnew(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  b->flags |= B_VALID;
+  return b;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -115,30 +394,183 @@ bwrite(struct buf *b)
   iderw(b);
 }
 
+// Start reading block blockno of dev into the cache and return
+// without waiting for the disk.  Does nothing if the block is
+// cached or on its way already, or if prefetches in flight hold
+// half the cache already.
+void
+bprefetch(uint dev, uint blockno)
+{
+  struct bucket *k;
+  struct buf *b;
+
+  k = bhash(dev, blockno);
+  acquire(&k->lock);
+  b = bfind(k, dev, blockno);
+  release(&k->lock);
+  if(b != 0)
+    return;
+  acquire(&bcache.lock);
+  if(bcache.nasync >= bcache.ngroup*NGBUF/2){
+    release(&bcache.lock);
+    return;
+  }
+  bcache.nasync++;
+  release(&bcache.lock);
+  b = bget(dev, blockno);
+  if(b->flags & B_VALID){
+    bdone(b);
+    return;
+  }
+  idereadasync(b);
+}
+
+// Finish a prefetch: the disk interrupt calls this when the
+// read that bprefetch() started is done.
+void
+bdone(struct buf *b)
+{
+  acquire(&bcache.lock);
+  bcache.nasync--;
+  release(&bcache.lock);
+  brelse(b);
+}
+
+// Return the locked buffer for block blockno of dev if the cache
+// holds its contents.  Otherwise start reading it, as bprefetch()
+// does, and return 0 rather than wait.
+struct buf*
+bpeek(uint dev, uint blockno)
+{
+  struct bucket *k;
+  struct buf *b;
+
+  k = bhash(dev, blockno);
+  acquire(&k->lock);
+  if((b = bfind(k, dev, blockno)) == 0){
+    release(&k->lock);
+    bprefetch(dev, blockno);
+    return 0;
+  }
+  if((b->flags & B_VALID) == 0){
+    release(&k->lock);
+    return 0;
+  }
+  b->refcnt++;
+  b->ref = 1;
+  k->hits++;
+  release(&k->lock);
+  acquiresleep(&b->lock);
+  return b;
+}
+
+// Drop block blockno of dev from the cache if it is there and
+// nobody is using it.
+void
+bforget(uint dev, uint blockno)
+{
+  struct bucket *k;
+  struct buf *b;
+
+  k = bhash(dev, blockno);
+  acquire(&bcache.lock);
+  acquire(&k->lock);
+  if((b = bfind(k, dev, blockno)) != 0 && bunhash(b, k)){
+    qremove(b);
+    qpush(BQ_FREE, b);
+  }
+  release(&k->lock);
+  release(&bcache.lock);
+}
+
 // Release a locked buffer.
-// Move to the head of the MRU list.
 void
 brelse(struct buf *b)
 {
+  struct bucket *k;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  // b cannot move to another bucket while we hold a reference.
+  k = bhash(b->dev, b->blockno);
+  acquire(&k->lock);
   b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
+  release(&k->lock);
+}
+
+// Whether every buffer of g looks idle.  Only a hint: refcnt is
+// read without the bucket locks.
+static int
+groupidle(struct bufgroup *g)
+{
+  int i;
+
+  for(i = 0; i < NGBUF; i++)
+    if(g->buf[i].refcnt != 0 || (g->buf[i].flags & B_DIRTY))
+      return 0;
+  return 1;
+}
+
+// Give a group of buffers back to the page allocator, if there is
+// one whose blocks are all idle.  Called when memory is short.
+// Returns 0 if a group was freed.
+int
+bshrink(void)
+{
+  struct bufgroup *g, **pg;
+  struct buf *b;
+  int i;
+
+  acquire(&bcache.lock);
+  for(pg = &bcache.groups; (g = *pg) != 0; pg = &g->next){
+    if(bcache.ngroup <= NMINGROUP)
+      break;
+    if(!groupidle(g))
+      continue;
+    for(i = 0; i < NGBUF; i++){
+      b = &g->buf[i];
+      if(b->queue == BQ_FREE)
+        continue;
+      if(!bunhash(b, 0))
+        break;
+      qremove(b);
+      qpush(BQ_FREE, b);
+    }
+    if(i < NGBUF)
+      continue;
+    for(i = 0; i < NGBUF; i++)
+      qremove(&g->buf[i]);
+    *pg = g->next;
+    bcache.ngroup--;
+    release(&bcache.lock);
+    for(i = 0; i < NGPAGE; i++)
+      kfree(g->data[i]);
+    kfree((char*)g);
+    return 0;
+  }
   release(&bcache.lock);
+  return -1;
+}
+
+// Fill in the buffer cache part of *mi.
+void
+bcacheinfo(struct meminfo *mi)
+{
+  struct bucket *k;
+
+  acquire(&bcache.lock);
+  mi->nbuf = bcache.ngroup * NGBUF;
+  mi->bufmisses = bcache.misses;
+  release(&bcache.lock);
+  mi->bufhits = 0;
+  for(k = bcache.bucket; k < bcache.bucket+NBUCKET; k++){
+    acquire(&k->lock);
+    mi->bufhits += k->hits;
+    release(&k->lock);
+  }
 }
 //PAGEBREAK!
 // Blank page.
-
@@ -4,11 +4,19 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  struct buf *prev; // replacement queue
   struct buf *next;
+  struct buf *hnext; // hash chain
   struct buf *qnext; // disk queue
-  uchar data[BSIZE];
+  uchar queue;      // which replacement queue, BQ_
+  uchar ref;        // hit since the CLOCK hand last passed
+  uchar *data;      // BSIZE bytes
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_ASYNC 0x8  // read started by bprefetch()
 
+// Replacement queues.
+#define BQ_FREE 0    // holds no block
+#define BQ_IN   1    // A1in: read once
+#define BQ_MAIN 2    // Am: read again after leaving A1in
@@ -259,7 +259,11 @@ consoleread(struct inode *ip, char *dst, int n)
       }
       break;
     }
-    *dst++ = c;
+    if(umemmove(dst++, &c, 1) < 0){
+      release(&cons.lock);
+      ilock(ip);
+      return -1;
+    }
     --n;
     if(c == '\n')
       break;
@@ -274,15 +278,19 @@ int
 consolewrite(struct inode *ip, char *buf, int n)
 {
   int i;
+  char c;
 
   iunlock(ip);
   acquire(&cons.lock);
-  for(i = 0; i < n; i++)
-    consputc(buf[i] & 0xff);
+  for(i = 0; i < n; i++){
+    if(umemmove(&c, buf + i, 1) < 0)
+      break;
+    consputc(c & 0xff);
+  }
   release(&cons.lock);
   ilock(ip);
 
-  return n;
+  return i == n ? n : -1;
 }
 
 void
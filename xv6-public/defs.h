@@ -4,7 +4,10 @@ struct file;
 struct inode;
 struct pipe;
 struct proc;
+struct meminfo;
+struct procmem;
 struct rtcdate;
+struct shmseg;
 struct spinlock;
 struct sleeplock;
 struct stat;
@@ -13,8 +16,15 @@ struct superblock;
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bnew(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+int             bshrink(void);
+void            bprefetch(uint, uint);
+void            bdone(struct buf*);
+struct buf*     bpeek(uint, uint);
+void            bforget(uint, uint);
+void            bcacheinfo(struct meminfo*);
 
 // console.c
 void            consoleinit(void);
@@ -24,6 +34,8 @@ void            panic(char*) __attribute__((noreturn));
 
 // exec.c
 int             exec(char*, char**);
+pde_t*          execload(char*, char**, uint*, uint*, uint*);
+void            execname(struct proc*, char*);
 
 // file.c
 struct file*    filealloc(void);
@@ -33,6 +45,13 @@ void            fileinit(void);
 int             fileread(struct file*, char*, int n);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             fdalloc(struct file*);
+struct file*    fdfile(int);
+struct file*    fdremove(int);
+void            fdcloseall(struct proc*);
+struct inode*   cwdget(void);
+struct inode*   cwdset(struct inode*);
+int             fadvise_os(int, int, int, int);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
@@ -50,13 +69,26 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+uint            readahead(struct inode*, uint, uint);
+void            uncache(struct inode*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
+int             writeblocks(uint);
+int             iputblocks(void);
+
+// futex.c
+void            futexinit(void);
+int             futex_wait_os(uint, int, int);
+int             futex_wake_os(uint, int);
+void            futextick(void);
 
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            iderwstart(struct buf*);
+void            iderwwait(struct buf*);
+void            idereadasync(struct buf*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -64,10 +96,17 @@ extern uchar    ioapicid;
 void            ioapicinit(void);
 
 // kalloc.c
-char*           kalloc(void);
+char*           kalloc(int);
 void            kfree(char*);
+extern uchar*   pageref;
+void            kmeminfo(struct meminfo*);
+char*           kallocsuper(void);
+int             kref(char*);
+void            kfreesuper(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            meminit(void);
+extern uint     phystop;
 
 // kbd.c
 void            kbdintr(void);
@@ -78,15 +117,63 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(uchar, int);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
 // log.c
 void            initlog(int dev);
 void            log_write(struct buf*);
+void            log_data(struct buf*);
+int             log_inuse(uint);
 void            begin_op();
+void            begin_opn(int);
 void            end_op();
 
+// mmap.c
+void            mmapinit(void);
+struct proc*    vmaproc(struct proc*);
+uint            mmapbase(struct proc*);
+int             mmapfault(uint, int);
+int             mmapuser(uint, uint, int);
+int             mmapstr(uint, char**);
+int             mmapfork(struct proc*, struct proc*);
+void            mmapexit(struct proc*);
+int             munmap_os(uint, int);
+int             mmapshared(struct proc*, uint);
+int             shmat_os(int);
+int             shmdt_os(uint);
+uint            stacktop(struct proc*, int);
+int             stackalloc(struct proc*, int);
+void            stackfree(struct proc*, int);
+
+// swap.c
+void            swapinit(int);
+char*           swapalloc(void);
+void            swapfree(uint);
+int             swapin(pde_t*, uint);
+void            swapread(uint, char*);
+void            swapuser(uint, uint);
+void            swapinfo(struct meminfo*);
+
+// pcache.c
+void            pcacheinit(void);
+int             pcachemap(struct inode*);
+void            pcachedup(struct inode*);
+char*           pcachefind(struct inode*, uint);
+char*           pcachepage(struct inode*, uint);
+void            pcachedirty(struct inode*, uint);
+void            pcacheput(struct inode*);
+
+// shm.c
+void            shminit(void);
+struct shmseg*  shmanon(uint);
+void            shmdup(struct shmseg*);
+void            shmrelease(struct shmseg*);
+char*           shmpage(struct shmseg*, uint);
+struct shmseg*  shmget_os(int, uint*);
+int             shmrm_os(int);
+
 // mp.c
 extern int      ismp;
 void            mpinit(void);
@@ -106,7 +193,11 @@ int             pipewrite(struct pipe*, char*, int);
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
+int             kthread(char*, void (*)(void));
+int             spawnproc(char*, char**, int*);
 int             growproc(int);
+char*           swapvictim(uint);
+int             procmeminfo(struct procmem*, int);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
@@ -115,10 +206,13 @@ void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
+struct proc*    threadproc(struct proc*, uint);
+void            tidunclaim(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+void            wakeupproc(struct proc*, void*);
 int             yield(void);
 void		set_table(int);
 
@@ -151,8 +245,9 @@ char*           strncpy(char*, const char*, int);
 
 // syscall.c
 int             argint(int, int*);
-int             argptr(int, char**, int);
+int             argptr(int, char**, int, int);
 int             argstr(int, char**);
+int             argpath(int, char*);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
 void            syscall(void);
@@ -166,6 +261,9 @@ extern uint     ticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
 
+// umem.S
+int             umemmove(void*, void*, uint);
+
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
@@ -174,9 +272,13 @@ void            uartputc(int);
 // vm.c
 void            seginit(void);
 void            kvmalloc(void);
+int             kvmmap(uint, uint);
+uint*           walkpgdir(pde_t*, const void*, int);
+int             mappages(pde_t*, void*, uint, uint, int);
 pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
+int             allocsuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
@@ -184,8 +286,10 @@ int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
+void            tlbflush(pde_t*);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+void            uvmcount(pde_t*, uint*, uint*);
 int		printk_str(char*);
 int		getppid(void);
 int		set_cpu_share(int);
@@ -195,5 +299,20 @@ int		thread_join(thread_t, void **);
 void		thread_exit(void *);
 int		pwrite(int, void*, int, int);
 int		pread(int, void*, int, int);
+int		set_superpage(int);
+int		mmap(uint, int, int, int, int, int);
+int		munmap(uint, int);
+int		shmget(int, int, int);
+int		shmat(int);
+int		shmdt(uint);
+int		shmrm(int);
+int		meminfo(struct meminfo*, struct procmem*, int);
+int		spawn(char*, char**, int*);
+int		set_thread_stack(int);
+int		thread_join_any(thread_t*, void**);
+int		futex_wait(int*, int, int);
+int		futex_wake(int*, int);
+int		set_tls(uint);
+int		fadvise(int, int, int, int);
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
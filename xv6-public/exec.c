@@ -7,24 +7,27 @@
 #include "x86.h"
 #include "elf.h"
 
-int
-exec(char *path, char **argv)
+// Build a user image running path with arguments argv, strings in
+// the caller's user memory, in a new page table.  Returns the page
+// table and sets *szp, *eipp and *espp for the first instruction,
+// or returns 0.
+pde_t*
+execload(char *path, char **argv, uint *szp, uint *eipp, uint *espp)
 {
-  char *s, *last;
-  int i, off;
+  int i, off, len;
+  char *s;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
-  struct proc *curproc = myproc();
+  pde_t *pgdir;
 
-  begin_op();
+  begin_opn(iputblocks());
 
   if((ip = namei(path)) == 0){
     end_op();
     cprintf("exec: fail\n");
-    return -1;
+    return 0;
   }
   ilock(ip);
   pgdir = 0;
@@ -72,8 +75,10 @@ exec(char *path, char **argv)
   for(argc = 0; argv[argc]; argc++) {
     if(argc >= MAXARG)
       goto bad;
-    sp = (sp - (strlen(argv[argc]) + 1)) & ~3;
-    if(copyout(pgdir, sp, argv[argc], strlen(argv[argc]) + 1) < 0)
+    if((len = fetchstr((uint)argv[argc], &s)) < 0)
+      goto bad;
+    sp = (sp - (len + 1)) & ~3;
+    if(copyout(pgdir, sp, s, len) < 0 || copyout(pgdir, sp + len, "", 1) < 0)
       goto bad;
     ustack[3+argc] = sp;
   }
@@ -87,32 +92,65 @@ exec(char *path, char **argv)
   if(copyout(pgdir, sp, ustack, (3+argc+1)*4) < 0)
     goto bad;
 
-  // Save program name for debugging.
+  *szp = sz;
+  *eipp = elf.entry;
+  *espp = sp;
+  return pgdir;
+
+ bad:
+  if(pgdir)
+    freevm(pgdir);
+  if(ip){
+    iunlockput(ip);
+    end_op();
+  }
+  return 0;
+}
+
+// Name a process after the last element of path.
+void
+execname(struct proc *p, char *path)
+{
+  char *s, *last;
+
   for(last=s=path; *s; s++)
     if(*s == '/')
       last = s+1;
-  safestrcpy(curproc->name, last, sizeof(curproc->name));
+  safestrcpy(p->name, last, sizeof(p->name));
+}
+
+int
+exec(char *path, char **argv)
+{
+  uint sz, eip, sp;
+  pde_t *pgdir, *oldpgdir;
+  struct proc *curproc = myproc();
+
+  if((pgdir = execload(path, argv, &sz, &eip, &sp)) == 0)
+    return -1;
+
+  // Save program name for debugging.
+  execname(curproc, path);
+
+  // Drop the old image's mmap regions.
+  mmapexit(curproc);
 
   // Commit to the user image.
   oldpgdir = curproc->pgdir;
   curproc->pgdir = pgdir;
   curproc->sz = sz;
-  curproc->tf->eip = elf.entry;  // main
+  curproc->superpage = 0;
+  curproc->tstack = TSTACKSIZE;
+  curproc->tls = 0;
+  curproc->tf->gs = 0;
+  curproc->tf->eip = eip;  // main
   curproc->tf->esp = sp;
   switchuvm(curproc);
+  tidunclaim(curproc);
   if(curproc->tid != 0){
 	cprintf("eieieiei\n");
 	exit();
   }
   freevm(oldpgdir);
   return 0;
-
- bad:
-  if(pgdir)
-    freevm(pgdir);
-  if(ip){
-    iunlockput(ip);
-    end_op();
-  }
-  return -1;
 }
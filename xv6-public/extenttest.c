@@ -0,0 +1,115 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+
+// Extent-mapped files: NWRITER processes append to their own files
+// at once, so that their blocks interleave on disk and the extent
+// trees split, then each file is overwritten in the middle and read
+// back, and the reads of a file are timed.
+
+#define NWRITER 4
+#define NBLOCK  2048
+
+char buf[BSIZE];
+char name[] = "extent0.tmp";
+
+void
+fail(char *msg)
+{
+  printf(1, "extenttest: %s failed\n", msg);
+  exit();
+}
+
+void
+fill(int w, int i, int gen)
+{
+  memset(buf, w + gen, BSIZE);
+  ((int*)buf)[0] = i;
+}
+
+void
+writer(int w)
+{
+  int fd, i;
+
+  name[6] = '0' + w;
+  if((fd = open(name, O_CREATE|O_RDWR)) < 0)
+    fail("create");
+  for(i = 0; i < NBLOCK; i++){
+    fill(w, i, 0);
+    if(write(fd, buf, BSIZE) != BSIZE)
+      fail("write");
+  }
+  close(fd);
+}
+
+// Read file w back; blocks [lo, hi) should be of generation 1.
+int
+check(int w, int lo, int hi)
+{
+  char want[BSIZE];
+  int fd, i, j, start;
+
+  name[6] = '0' + w;
+  if((fd = open(name, O_RDONLY)) < 0)
+    fail("open");
+  start = uptime();
+  for(i = 0; i < NBLOCK; i++){
+    if(read(fd, want, BSIZE) != BSIZE)
+      fail("read");
+    fill(w, i, i >= lo && i < hi);
+    for(j = 0; j < BSIZE; j++)
+      if(want[j] != buf[j])
+        fail("data");
+  }
+  if(read(fd, want, 1) != 0)
+    fail("size");
+  close(fd);
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int w, i, fd, ticks;
+
+  for(w = 0; w < NWRITER; w++){
+    if(fork() == 0){
+      writer(w);
+      exit();
+    }
+  }
+  for(w = 0; w < NWRITER; w++)
+    wait();
+  for(w = 0; w < NWRITER; w++)
+    check(w, 0, 0);
+  printf(1, "%d interleaved files: ok\n", NWRITER);
+
+  for(w = 0; w < NWRITER; w++){
+    name[6] = '0' + w;
+    if((fd = open(name, O_RDWR)) < 0)
+      fail("open");
+    for(i = NBLOCK/4; i < NBLOCK/2; i++){
+      fill(w, i, 1);
+      if(pwrite(fd, buf, BSIZE, i*BSIZE) != BSIZE)
+        fail("pwrite");
+    }
+    close(fd);
+  }
+  ticks = 0;
+  for(w = 0; w < NWRITER; w++)
+    ticks += check(w, NBLOCK/4, NBLOCK/2);
+  if(ticks == 0)
+    ticks = 1;
+  printf(1, "overwrite: ok, read %d KB/s\n",
+         NWRITER * NBLOCK / 2 * 100 / ticks);
+
+  for(w = 0; w < NWRITER; w++){
+    name[6] = '0' + w;
+    if(unlink(name) < 0)
+      fail("unlink");
+  }
+  exit();
+}
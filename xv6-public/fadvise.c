@@ -0,0 +1,21 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "date.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+
+int fadvise(int fd, int off, int len, int advice){
+
+	return fadvise_os(fd, off, len, advice);
+}
+
+int fadvise_w(void){
+	int fd, off, len, advice;
+
+	if(argint(0,&fd) < 0 || argint(1,&off) < 0 || argint(2,&len) < 0 || argint(3,&advice) < 0)
+	 return -1;
+	return fadvise(fd, off, len, advice);
+}
@@ -2,3 +2,10 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+
+// fadvise() advice
+#define FADV_NORMAL     0  // read ahead when reads are sequential
+#define FADV_SEQUENTIAL 1  // always read ahead, with the largest window
+#define FADV_RANDOM     2  // never read ahead
+#define FADV_WILLNEED   3  // read the range in now
+#define FADV_DONTNEED   4  // drop the range from the cache
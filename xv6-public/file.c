@@ -15,6 +15,8 @@
 #include "fcntl.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
+#define RAMIN 4    // first readahead window, in blocks
+#define RAMAX 64   // largest readahead window
 struct devsw devsw[NDEV];
 struct {
   struct spinlock lock;
@@ -87,25 +89,156 @@ fileclose(struct file *f)
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
   else if(ff.type == FD_INODE){
-    begin_op();
+    begin_opn(iputblocks());
     iput(ff.ip);
     end_op();
   }
 }
 
+// Threads share the file table and current directory of the
+// process that created them (see vmaproc()), so changes to
+// either are made under ftable.lock.
+
+// Allocate a file descriptor for the given file.
+// Takes over file reference from caller on success.
+int
+fdalloc(struct file *f)
+{
+  struct proc *p = vmaproc(myproc());
+  int fd;
+
+  acquire(&ftable.lock);
+  for(fd = 0; fd < NOFILE; fd++){
+    if(p->ofile[fd] == 0){
+      p->ofile[fd] = f;
+      release(&ftable.lock);
+      return fd;
+    }
+  }
+  release(&ftable.lock);
+  return -1;
+}
+
+// The open file with descriptor fd, or 0.  The caller gets a
+// reference of its own, so that a close() of fd by another thread
+// cannot free the file under it, and drops it with fileclose().
+struct file*
+fdfile(int fd)
+{
+  struct file *f;
+
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  acquire(&ftable.lock);
+  if((f = vmaproc(myproc())->ofile[fd]) != 0)
+    f->ref++;
+  release(&ftable.lock);
+  return f;
+}
+
+// Free descriptor fd and return its file, for the caller to
+// close, or 0 if fd was not open.
+struct file*
+fdremove(int fd)
+{
+  struct proc *p = vmaproc(myproc());
+  struct file *f;
+
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  acquire(&ftable.lock);
+  f = p->ofile[fd];
+  p->ofile[fd] = 0;
+  release(&ftable.lock);
+  return f;
+}
+
+// Close all of p's open files, when p exits.  Its threads may
+// still be using some, but through references of their own.
+void
+fdcloseall(struct proc *p)
+{
+  struct file *f;
+  int fd;
+
+  for(fd = 0; fd < NOFILE; fd++){
+    acquire(&ftable.lock);
+    f = p->ofile[fd];
+    p->ofile[fd] = 0;
+    release(&ftable.lock);
+    if(f)
+      fileclose(f);
+  }
+}
+
+// A new reference to the current directory.
+struct inode*
+cwdget(void)
+{
+  struct inode *ip;
+
+  acquire(&ftable.lock);
+  ip = idup(vmaproc(myproc())->cwd);
+  release(&ftable.lock);
+  return ip;
+}
+
+// Make ip the current directory, taking over the caller's
+// reference.  Returns the old one for the caller to iput().
+struct inode*
+cwdset(struct inode *ip)
+{
+  struct proc *p = vmaproc(myproc());
+  struct inode *old;
+
+  acquire(&ftable.lock);
+  old = p->cwd;
+  p->cwd = ip;
+  release(&ftable.lock);
+  return old;
+}
+
 // Get metadata about file f.
 int
 filestat(struct file *f, struct stat *st)
 {
+  struct stat s;
+
   if(f->type == FD_INODE){
     ilock(f->ip);
-    stati(f->ip, st);
+    stati(f->ip, &s);
     iunlock(f->ip);
-    return 0;
+    return umemmove(st, &s, sizeof(s));
   }
   return -1;
 }
 
+// Read ahead after a read of n bytes at off.  A read that starts
+// where the last one ended doubles the window, up to RAMAX blocks,
+// and any other read closes it.  More blocks are requested once
+// the reader is half way through those already requested.
+// Caller holds f->ip->lock.
+static void
+fileahead(struct file *f, uint off, uint n)
+{
+  uint bn;
+
+  if(f->advice == FADV_RANDOM)
+    return;
+  if(f->advice == FADV_SEQUENTIAL)
+    f->rawin = RAMAX;
+  else if(off == f->ranext)
+    f->rawin = f->rawin ? min(2*f->rawin, RAMAX) : RAMIN;
+  else
+    f->rawin = 0;
+  f->ranext = off + n;
+  bn = (off + n) / BSIZE;
+  if(f->raend < bn || f->rawin == 0)
+    f->raend = bn;
+  if(f->rawin != 0 && f->raend - bn <= f->rawin/2)
+    f->raend = readahead(f->ip, f->raend, bn + f->rawin - f->raend);
+}
+
 // Read from file f.
 int
 fileread(struct file *f, char *addr, int n)
@@ -118,8 +251,10 @@ fileread(struct file *f, char *addr, int n)
     return piperead(f->pipe, addr, n);
   if(f->type == FD_INODE){
     ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0)
+    if((r = readi(f->ip, addr, f->off, n)) > 0){
+      fileahead(f, f->off, r);
       f->off += r;
+    }
     iunlock(f->ip);
     return r;
   }
@@ -151,7 +286,7 @@ filewrite(struct file *f, char *addr, int n)
       if(n1 > max)
         n1 = max;
 
-      begin_op();
+      begin_opn(writeblocks(n1));
       ilock(f->ip);
       if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
         f->off += r;
@@ -172,7 +307,7 @@ int pwrite_os(int fd, void* addr, int n, int off) {
 	struct file *f;
 	int r;
 
-	if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0){
+	if((f=fdfile(fd)) == 0){
 	 cprintf("[pwriete]error!\n");
 	 return -1;
 	}
@@ -189,7 +324,7 @@ int pwrite_os(int fd, void* addr, int n, int off) {
       		int n1 = n - i;
       		if(n1 > max)
         		n1 = max;
-      		begin_op();
+      		begin_opn(writeblocks(n1));
       		ilock(f->ip);
 		if(off > f->ip->size) { //By this statement, os can avoid inappropriate error in 'writei' function. It sets new ip size.
 			int off_x = off;
@@ -216,6 +351,7 @@ int pwrite_os(int fd, void* addr, int n, int off) {
         		panic("short filewrite");
       		i += r;
     	}
+    	fileclose(f);
     	return i == n ? n : -1;
   }
   panic("filewrite");
@@ -225,7 +361,7 @@ int pwrite_os(int fd, void* addr, int n, int off) {
 int pread_os(int fd, void* addr, int n, int off) {
 	struct file *f;
 	int r;
-	if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0){
+	if((f=fdfile(fd)) == 0){
 	 cprintf("[pread]error!\n");
 	 return -1;
 	}
@@ -234,8 +370,49 @@ int pread_os(int fd, void* addr, int n, int off) {
    	 if((r = readi(f->ip, addr, off, n)) > 0)
       		off += r;
     	 iunlock(f->ip);
+    	 fileclose(f);
     	 return r;
   	}
   	panic("ErrorR on pread");
   	return 0;
 }
+
+// Advise how file fd will be read from off for len bytes, or to
+// the end of the file if len is 0.
+int
+fadvise_os(int fd, int off, int len, int advice)
+{
+  struct file *f;
+  uint bn, n;
+  int r;
+
+  if((f = fdfile(fd)) == 0)
+    return -1;
+  r = -1;
+  if(f->type != FD_INODE || off < 0 || len < 0)
+    goto out;
+  switch(advice){
+  case FADV_NORMAL:
+  case FADV_SEQUENTIAL:
+  case FADV_RANDOM:
+    f->advice = advice;
+    f->rawin = 0;
+    r = 0;
+    break;
+  case FADV_WILLNEED:
+  case FADV_DONTNEED:
+    bn = off / BSIZE;
+    n = len == 0 ? MAXFILE : (off + len + BSIZE - 1) / BSIZE - bn;
+    ilock(f->ip);
+    if(advice == FADV_WILLNEED)
+      readahead(f->ip, bn, n);
+    else
+      uncache(f->ip, bn, n);
+    iunlock(f->ip);
+    r = 0;
+    break;
+  }
+out:
+  fileclose(f);
+  return r;
+}
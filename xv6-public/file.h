@@ -6,9 +6,15 @@ struct file {
   struct pipe *pipe;
   struct inode *ip;
   uint off;
+  int advice;   // FADV_ from fadvise()
+  uint ranext;  // offset where a sequential read would start
+  uint raend;   // block after the last one read ahead
+  uint rawin;   // readahead window, in blocks
 };
 
 
+#define NECACHE 4   // extents each in-memory inode remembers
+
 // in-memory copy of an inode
 struct inode {
   uint dev;           // Device number
@@ -23,6 +29,11 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+3];
+
+  int extents;        // addrs[] is the root of an extent tree
+  struct extent ecache[NECACHE];  // extents looked up lately
+  int enext;          // ecache slot to reuse next
+  struct pcache *pc;  // pages MAP_SHARED regions map, or 0 (pcache.c)
 };
 
 // table mapping major device number to
@@ -0,0 +1,48 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "fs.h"
+#include "meminfo.h"
+
+// Print memory use: page allocator totals and classes, swap, and
+// the resident set of each process.  All sizes are in KB.
+
+#define KB(pages) ((pages)*4)
+
+static char *classes[NKM] = { "pgtable", "kstack", "user", "pipe", "buf", "shm", "proc" };
+static char *states[] = { "unused", "embryo", "sleep", "runble", "run", "zombie" };
+
+struct procmem pm[NPROC];
+
+int
+main(int argc, char *argv[])
+{
+  struct meminfo mi;
+  uint used;
+  int i, n;
+
+  if((n = meminfo(&mi, pm, NPROC)) < 0){
+    printf(2, "free: meminfo failed\n");
+    exit();
+  }
+  used = 0;
+  for(i = 0; i < NKM; i++)
+    used += mi.used[i];
+  printf(1, "          total      used      free\n");
+  printf(1, "mem:  %d  %d  %d\n", KB(mi.total), KB(used), KB(mi.free));
+  printf(1, "swap: %d  %d  %d\n", KB(mi.swaptotal), KB(mi.swapused),
+         KB(mi.swaptotal - mi.swapused));
+  printf(1, "bcache: %d  hits %d  misses %d\n", mi.nbuf*BSIZE/1024,
+         mi.bufhits, mi.bufmisses);
+  printf(1, "\nused by:");
+  for(i = 0; i < NKM; i++)
+    printf(1, " %s %d", classes[i], KB(mi.used[i]));
+  printf(1, "\n\npid\tstate\tthreads\tsize\trss\tswap\tname\n");
+  for(i = 0; i < n; i++)
+    printf(1, "%d\t%s\t%d\t%d\t%d\t%d\t%s\n", pm[i].pid,
+           pm[i].state >= 0 && pm[i].state < sizeof(states)/sizeof(states[0]) ? states[pm[i].state] : "???",
+           pm[i].nthread, pm[i].sz/1024, KB(pm[i].rss), KB(pm[i].swapped),
+           pm[i].name);
+  exit();
+}
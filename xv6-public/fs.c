@@ -22,6 +22,9 @@
 #include "file.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
+// Whether the blocks of ip are file data, for log_data(); the
+// contents of directories are metadata and always logged.
+#define FILEDATA(ip) ((ip)->type != T_DIR)
 static void itrunc(struct inode*);
 // there should be one superblock per disk device, but we run with
 // only one device
@@ -38,37 +41,53 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
-// Zero a block.
+// Zero a block, through log_data() if it is to hold file data.
+// Its old contents are never read.
 static void
-bzero(int dev, int bno)
+bzero(int dev, int bno, int data)
 {
   struct buf *bp;
 
-  bp = bread(dev, bno);
+  bp = bnew(dev, bno);
   memset(bp->data, 0, BSIZE);
-  log_write(bp);
+  if(data)
+    log_data(bp);
+  else
+    log_write(bp);
   brelse(bp);
 }
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Allocate a disk block, the first free one from goal on, and
+// zero it, as file data if data is 1 or as metadata if it is 0.
+// If data is -1 the caller fills the whole block itself.
+// Blocks freed by transactions that have not committed yet are
+// skipped, as file data may be written to the new block before
+// the commit (see log.c).
 static uint
-balloc(uint dev)
+balloc(uint dev, int data, uint goal)
 {
-  int b, bi, m;
+  int b, bi, m, i, nmap;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
+  // Search the free-map blocks from the one with goal in it,
+  // then that one again from the start.
+  nmap = sb.size/BPB + 1;
+  if(goal >= sb.size)
+    goal = 0;
+  for(i = 0; i <= nmap; i++){
+    b = (goal/BPB + i) % nmap * BPB;
     bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+    for(bi = i == 0 ? goal%BPB : 0; bi < BPB && b + bi < sb.size; bi++){
       m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
+      // Is block free, and was it when last committed?
+      if((bp->data[bi/8] & m) == 0 && !log_inuse(b + bi)){
         bp->data[bi/8] |= m;  // Mark block in use.
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
+        if(data >= 0)
+          bzero(dev, b + bi, data);
         return b + bi;
       }
     }
@@ -205,6 +224,8 @@ ialloc(uint dev, short type)
     if(dip->type == 0){  // a free inode
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
+      if(EXTENTS && type == T_FILE)
+        dip->type |= I_EXTENT;
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
       return iget(dev, inum);
@@ -227,6 +248,8 @@ iupdate(struct inode *ip)
   bp = bread(ip->dev, IBLOCK(ip->inum, sb));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
   dip->type = ip->type;
+  if(ip->extents)
+    dip->type |= I_EXTENT;
   dip->major = ip->major;
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
@@ -299,7 +322,9 @@ ilock(struct inode *ip)
   if(ip->valid == 0){
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
     dip = (struct dinode*)bp->data + ip->inum%IPB;
-    ip->type = dip->type;
+    ip->type = dip->type & ~I_EXTENT;
+    ip->extents = (dip->type & I_EXTENT) != 0;
+    memset(ip->ecache, 0, sizeof(ip->ecache));
     ip->major = dip->major;
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
@@ -341,6 +366,7 @@ iput(struct inode *ip)
       // inode has no links and no other references: truncate and free.
       itrunc(ip);
       ip->type = 0;
+      ip->extents = 0;
       iupdate(ip);
       ip->valid = 0;
     }
@@ -368,17 +394,300 @@ iunlockput(struct inode *ip)
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
 // listed in block ip->addrs[NDIRECT].
 
+// Allocate a data block for ip, from goal on: zeroed, or, if
+// fresh is set, left for the caller to fill in, with *fresh set
+// to say so.
+static uint
+dalloc(struct inode *ip, int *fresh, uint goal)
+{
+  if(fresh == 0)
+    return balloc(ip->dev, FILEDATA(ip), goal);
+  *fresh = 1;
+  return balloc(ip->dev, -1, goal);
+}
+
+//PAGEBREAK!
+// Extents.
+//
+// The root of an extent inode's tree is in ip->addrs[], and a
+// block of a file goes just after the block before it when that
+// is free, so a file written front to back is a few long extents.
+// Mapping a block is a binary search in each node on the way down,
+// or nothing if the extent is one of the NECACHE that ip keeps.
+// Nodes split when full, and the root, when it splits, moves to a
+// block and takes its place one level up.
+
+#define EMAXDEPTH 3   // levels below the root; more than enough
+
+// A node of an extent tree: the root, with bp 0, or block bp.
+struct enode {
+  struct buf *bp;
+  struct exthdr *h;
+  void *e;              // Entries
+  int cap;              // Room for entries
+};
+
+#define EXT(n, i) ((struct extent*)(n)->e + (i))
+#define IDX(n, i) ((struct extidx*)(n)->e + (i))
+
+static int
+esize(int depth)
+{
+  return depth == 0 ? sizeof(struct extent) : sizeof(struct extidx);
+}
+
+// Set up n for the size bytes at mem, read from bp or the root.
+static void
+enode(struct enode *n, struct buf *bp, void *mem, int size)
+{
+  n->bp = bp;
+  n->h = (struct exthdr*)mem;
+  n->e = n->h + 1;
+  n->cap = (size - sizeof(struct exthdr)) / esize(n->h->depth);
+}
+
+static uint
+ekey(struct enode *n, int i)
+{
+  return n->h->depth == 0 ? EXT(n, i)->fbn : IDX(n, i)->fbn;
+}
+
+// The last entry of n whose key is at most fbn, or -1.
+static int
+esearch(struct enode *n, uint fbn)
+{
+  int lo, hi, mid;
+
+  lo = -1;
+  hi = n->h->n - 1;
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(ekey(n, mid) <= fbn)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+// Remember extent e in ip's cache, over an older copy of it.
+static void
+ecache(struct inode *ip, struct extent *e)
+{
+  int i;
+
+  for(i = 0; i < NECACHE; i++)
+    if(ip->ecache[i].len > 0 && ip->ecache[i].fbn == e->fbn)
+      break;
+  if(i == NECACHE){
+    i = ip->enext;
+    ip->enext = (ip->enext + 1) % NECACHE;
+  }
+  ip->ecache[i] = *e;
+}
+
+// Find the extent of ip with file block bn in it, into *e.
+// Returns 0 if there is none, and also, if peek is set and a node
+// on the way is not in the cache yet, after starting to read it.
+static int
+elookup(struct inode *ip, uint bn, struct extent *e, int peek)
+{
+  struct enode n;
+  struct buf *bp;
+  uint blk;
+  int i, found;
+
+  for(i = 0; i < NECACHE; i++){
+    *e = ip->ecache[i];
+    if(e->len > 0 && bn >= e->fbn && bn - e->fbn < e->len)
+      return 1;
+  }
+  enode(&n, 0, ip->addrs, sizeof(ip->addrs));
+  while((i = esearch(&n, bn)) >= 0 && n.h->depth > 0){
+    blk = IDX(&n, i)->blk;
+    if(n.bp)
+      brelse(n.bp);
+    if(peek)
+      bp = bpeek(ip->dev, blk);
+    else
+      bp = bread(ip->dev, blk);
+    if(bp == 0)
+      return 0;
+    enode(&n, bp, bp->data, BSIZE);
+  }
+  found = i >= 0 && bn - EXT(&n, i)->fbn < EXT(&n, i)->len;
+  if(found){
+    *e = *EXT(&n, i);
+    ecache(ip, e);
+  }
+  if(n.bp)
+    brelse(n.bp);
+  return found;
+}
+
+// Put entry x at index i of node n.  If n is full, the entries
+// from the middle on move to a new block, which is returned, with
+// its first key in *key; otherwise returns 0.  An entry added at
+// the end, as appending does, goes alone into the new block, so
+// that the nodes of a file written in order stay full.
+static uint
+eadd(struct inode *ip, struct enode *n, int i, void *x, uint *key)
+{
+  struct enode s;
+  struct buf *bp;
+  uint blk;
+  int sz, mid;
+
+  sz = esize(n->h->depth);
+  if(n->h->n < n->cap){
+    memmove((char*)n->e + (i+1)*sz, (char*)n->e + i*sz, (n->h->n - i)*sz);
+    memmove((char*)n->e + i*sz, x, sz);
+    n->h->n++;
+    return 0;
+  }
+  blk = balloc(ip->dev, 0, 0);
+  bp = bread(ip->dev, blk);
+  ((struct exthdr*)bp->data)->depth = n->h->depth;
+  enode(&s, bp, bp->data, BSIZE);
+  mid = i == n->h->n ? i : n->h->n / 2;
+  s.h->n = n->h->n - mid;
+  memmove(s.e, (char*)n->e + mid*sz, s.h->n*sz);
+  n->h->n = mid;
+  if(i < mid)
+    eadd(ip, n, i, x, key);
+  else
+    eadd(ip, &s, i - mid, x, key);
+  *key = ekey(&s, 0);
+  log_write(bp);
+  brelse(bp);
+  return blk;
+}
+
+// Add extent e to the subtree at n, merging it into the extent
+// before it if they are contiguous.  Returns as eadd().
+static uint
+einsert(struct inode *ip, struct enode *n, struct extent *e, uint *key)
+{
+  struct enode c;
+  struct extent *p;
+  struct extidx x;
+  struct buf *bp;
+  int i;
+
+  i = esearch(n, e->fbn);
+  if(n->h->depth == 0){
+    if(i >= 0){
+      p = EXT(n, i);
+      if(p->fbn + p->len == e->fbn && p->start + p->len == e->start){
+        p->len += e->len;
+        ecache(ip, p);
+        return 0;
+      }
+    }
+    ecache(ip, e);
+    return eadd(ip, n, i+1, e, key);
+  }
+  if(i < 0){
+    // e comes before everything under the first child.
+    i = 0;
+    IDX(n, 0)->fbn = e->fbn;
+  }
+  bp = bread(ip->dev, IDX(n, i)->blk);
+  enode(&c, bp, bp->data, BSIZE);
+  x.blk = einsert(ip, &c, e, &x.fbn);
+  log_write(bp);
+  brelse(bp);
+  if(x.blk == 0)
+    return 0;
+  return eadd(ip, n, i+1, &x, key);
+}
+
+// Map file block bn of ip to disk block addr.
+static void
+emapadd(struct inode *ip, uint bn, uint addr)
+{
+  struct enode root;
+  struct extent e;
+  struct extidx x[2];
+  struct buf *bp;
+
+  e.fbn = bn;
+  e.start = addr;
+  e.len = 1;
+  enode(&root, 0, ip->addrs, sizeof(ip->addrs));
+  if(root.h->depth == EMAXDEPTH && root.h->n == root.cap)
+    panic("emapadd: tree full");
+  if((x[1].blk = einsert(ip, &root, &e, &x[1].fbn)) != 0){
+    // The root split: move what it kept to a block, and make it
+    // the index of that block and the new one.
+    x[0].blk = balloc(ip->dev, 0, 0);
+    x[0].fbn = ekey(&root, 0);
+    bp = bread(ip->dev, x[0].blk);
+    memmove(bp->data, ip->addrs, sizeof(ip->addrs));
+    log_write(bp);
+    brelse(bp);
+    root.h->depth++;
+    root.h->n = 2;
+    memmove(root.e, x, sizeof(x));
+  }
+  iupdate(ip);
+}
+
+// bmap() for an extent inode.  A new block goes just after the
+// one before it, if that is free.
+static uint
+emap(struct inode *ip, uint bn, int *fresh)
+{
+  struct extent e;
+  uint addr, goal;
+
+  if(elookup(ip, bn, &e, 0))
+    return e.start + bn - e.fbn;
+  goal = 0;
+  if(bn > 0 && elookup(ip, bn-1, &e, 0))
+    goal = e.start + bn - e.fbn;
+  addr = dalloc(ip, fresh, goal);
+  emapadd(ip, bn, addr);
+  return addr;
+}
+
+// Free the extents and nodes of the subtree at n.
+static void
+efree(struct inode *ip, struct enode *n)
+{
+  struct enode c;
+  struct buf *bp;
+  uint b;
+  int i;
+
+  for(i = 0; i < n->h->n; i++){
+    if(n->h->depth == 0){
+      for(b = 0; b < EXT(n, i)->len; b++)
+        bfree(ip->dev, EXT(n, i)->start + b);
+      continue;
+    }
+    bp = bread(ip->dev, IDX(n, i)->blk);
+    enode(&c, bp, bp->data, BSIZE);
+    efree(ip, &c);
+    brelse(bp);
+    bfree(ip->dev, IDX(n, i)->blk);
+  }
+}
+
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, bmap allocates one, zeroed unless
+// the caller passes fresh (see dalloc()).
 static uint
-bmap(struct inode *ip, uint bn)
+bmap(struct inode *ip, uint bn, int *fresh)
 {
   uint addr,cn, *a, *b, *c;
   struct buf *bp;
 
+  if(ip->extents)
+    return emap(ip, bn, fresh);
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = dalloc(ip, fresh, 0);
     return addr;
   }
   bn -= NDIRECT;
@@ -386,11 +695,11 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT] = addr = balloc(ip->dev, 0, 0);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+      a[bn] = addr = dalloc(ip, fresh, 0);
       log_write(bp);
     }
     brelse(bp);
@@ -400,20 +709,20 @@ bmap(struct inode *ip, uint bn)
 
   if(bn < NINDIRECT * NINDIRECT){
     if((addr = ip->addrs[NDIRECT+1]) == 0) {
-      ip->addrs[NDIRECT+1] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT+1] = addr = balloc(ip->dev, 0, 0);
     }
     bp = bread(ip->dev,addr);
     a = (uint*)bp->data; // 'a' indicates first address table
 
     if((addr = a[bn/NINDIRECT]) == 0) {
-      a[bn/NINDIRECT] = addr = balloc(ip->dev);
+      a[bn/NINDIRECT] = addr = balloc(ip->dev, 0, 0);
       log_write(bp);
     }
     brelse(bp);
     bp = bread(ip->dev,addr);
     b = (uint*)bp->data; // 'b' indicates second(final) address table(i.e it indicates file block pointer)
     if((addr = b[bn%NINDIRECT]) == 0){
-      b[bn%NINDIRECT] = addr = balloc(ip->dev);
+      b[bn%NINDIRECT] = addr = dalloc(ip, fresh, 0);
       log_write(bp);
     }
     brelse(bp);
@@ -424,13 +733,13 @@ bmap(struct inode *ip, uint bn)
 
   if(bn < NINDIRECT * NINDIRECT * NINDIRECT){
     if((addr = ip->addrs[NDIRECT+2]) == 0) {
-      ip->addrs[NDIRECT+2] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT+2] = addr = balloc(ip->dev, 0, 0);
     }
     bp = bread(ip->dev,addr);
     a = (uint*)bp->data; // 'a' indicates first address table
 
     if((addr = a[bn/(NINDIRECT*NINDIRECT)]) == 0) {
-      a[bn/(NINDIRECT*NINDIRECT)] = addr = balloc(ip->dev);
+      a[bn/(NINDIRECT*NINDIRECT)] = addr = balloc(ip->dev, 0, 0);
       log_write(bp);
     }
     brelse(bp);
@@ -439,7 +748,7 @@ bmap(struct inode *ip, uint bn)
     cn = bn-((NINDIRECT*NINDIRECT)*(bn/(NINDIRECT*NINDIRECT)));
 
     if((addr = b[cn/NINDIRECT]) == 0){
-      b[cn/NINDIRECT] = addr = balloc(ip->dev);
+      b[cn/NINDIRECT] = addr = balloc(ip->dev, 0, 0);
       log_write(bp);
     }
     brelse(bp);
@@ -448,7 +757,7 @@ bmap(struct inode *ip, uint bn)
 
 
    if((addr = c[cn%NINDIRECT]) == 0) {
-     c[cn%NINDIRECT] = addr = balloc(ip->dev);
+     c[cn%NINDIRECT] = addr = dalloc(ip, fresh, 0);
      log_write(bp);
    }
    brelse(bp);
@@ -457,6 +766,83 @@ bmap(struct inode *ip, uint bn)
   panic("bmap: out of range");
 }
 
+// The disk address of block bn of ip, for readahead: 0 if the
+// block is not allocated, and also 0, after starting to read it,
+// if an indirect block on the way is not in the cache yet.
+// Never allocates and never waits for the disk.
+static uint
+bmapahead(struct inode *ip, uint bn)
+{
+  uint addr, level, span;
+  struct buf *bp;
+  struct extent e;
+
+  if(ip->extents)
+    return elookup(ip, bn, &e, 1) ? e.start + bn - e.fbn : 0;
+  if(bn < NDIRECT)
+    return ip->addrs[bn];
+  bn -= NDIRECT;
+
+  // Find the tree bn is in; span is the file blocks covered by
+  // one entry of the tree's top block.
+  span = 1;
+  for(level = 0; level < 3; level++){
+    if(bn < span*NINDIRECT)
+      break;
+    bn -= span*NINDIRECT;
+    span *= NINDIRECT;
+  }
+  if(level == 3)
+    return 0;
+  for(addr = ip->addrs[NDIRECT+level]; addr != 0 && span > 0; span /= NINDIRECT){
+    if((bp = bpeek(ip->dev, addr)) == 0)
+      return 0;
+    addr = ((uint*)bp->data)[bn/span];
+    bn %= span;
+    brelse(bp);
+  }
+  return addr;
+}
+
+// Start reading blocks [bn, bn+n) of ip into the cache without
+// waiting for them.  Stops early at an indirect block that is
+// still on its way in.  Returns the block it stopped at.
+// Caller must hold ip->lock.
+uint
+readahead(struct inode *ip, uint bn, uint n)
+{
+  uint addr, end;
+
+  end = (ip->size + BSIZE - 1) / BSIZE;
+  if(ip->type == T_DEV || bn >= end)
+    return bn;
+  if(n > end - bn)
+    n = end - bn;
+  for(; n > 0; bn++, n--){
+    if((addr = bmapahead(ip, bn)) == 0)
+      break;
+    bprefetch(ip->dev, addr);
+  }
+  return bn;
+}
+
+// Drop blocks [bn, bn+n) of ip from the cache where nobody is
+// using them.  Caller must hold ip->lock.
+void
+uncache(struct inode *ip, uint bn, uint n)
+{
+  uint addr, end;
+
+  end = (ip->size + BSIZE - 1) / BSIZE;
+  if(ip->type == T_DEV || bn >= end)
+    return;
+  if(n > end - bn)
+    n = end - bn;
+  for(; n > 0; bn++, n--)
+    if((addr = bmapahead(ip, bn)) != 0)
+      bforget(ip->dev, addr);
+}
+
 // Truncate inode (discard contents).
 // Only called when the inode has no links
 // to it (no directory entries referring to it)
@@ -468,6 +854,17 @@ itrunc(struct inode *ip)
   int i, j, k,l;
   struct buf *bp, *cp, *dp;
   uint *a, *b, *c;
+  struct enode root;
+
+  if(ip->extents){
+    enode(&root, 0, ip->addrs, sizeof(ip->addrs));
+    efree(ip, &root);
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    memset(ip->ecache, 0, sizeof(ip->ecache));
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -559,13 +956,14 @@ stati(struct inode *ip, struct stat *st)
 }
 
 //PAGEBREAK!
-// Read data from inode.
+// Read data from inode into dst, which may be user memory.
 // Caller must hold ip->lock.
 int
 readi(struct inode *ip, char *dst, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  char *pg;
 
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].read)
@@ -579,22 +977,33 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
-    memmove(dst, bp->data + off%BSIZE, m);
+    // A mapping may have changed the cached page.
+    if((pg = pcachefind(ip, off - off%PGSIZE)) != 0){
+      if(umemmove(dst, pg + off%PGSIZE, m) < 0)
+        return -1;
+      continue;
+    }
+    bp = bread(ip->dev, bmap(ip, off/BSIZE, 0));
+    if(umemmove(dst, bp->data + off%BSIZE, m) < 0){
+      brelse(bp);
+      return -1;
+    }
     brelse(bp);
   }
   return n;
 }
 
 // PAGEBREAK!
-// Write data to inode.
+// Write data to inode from src, which may be user memory.
 // Caller must hold ip->lock.
 int
 writei(struct inode *ip, char *src, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, addr;
+  int fresh, r;
   struct buf *bp;
+  char *pg;
 
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].write)
@@ -608,18 +1017,71 @@ writei(struct inode *ip, char *src, uint off, uint n)
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  r = n;
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    fresh = 0;
+    addr = bmap(ip, off/BSIZE, &fresh);
     m = min(n - tot, BSIZE - off%BSIZE);
-    memmove(bp->data + off%BSIZE, src, m);
-    log_write(bp);
+    if(fresh){
+      // A new block: nothing to read, and only the part that
+      // src does not cover needs zeroing.
+      bp = bnew(ip->dev, addr);
+      memset(bp->data, 0, off%BSIZE);
+      memset(bp->data + off%BSIZE + m, 0, BSIZE - off%BSIZE - m);
+    } else
+      bp = bread(ip->dev, addr);
+    if(umemmove(bp->data + off%BSIZE, src, m) < 0){
+      // src went away.  A new block must not keep what was
+      // in the buffer before.
+      if(fresh)
+        memset(bp->data + off%BSIZE, 0, m);
+      else
+        m = 0;
+      r = -1;
+    }
+    // Keep the page mappings see the same as the file.
+    if((pg = pcachefind(ip, off - off%PGSIZE)) != 0)
+      memmove(pg + off%PGSIZE, bp->data + off%BSIZE, m);
+    if(FILEDATA(ip))
+      log_data(bp);
+    else
+      log_write(bp);
     brelse(bp);
+    if(r < 0){
+      off += m;
+      break;
+    }
   }
   if(n > 0 && off > ip->size){
     ip->size = off;
     iupdate(ip);
   }
-  return n;
+  return r;
+}
+
+// The most blocks a writei() of n bytes, at any offset, can log:
+// the data blocks, the index blocks above them at each of three
+// levels or the extent tree nodes on the way down and those that
+// splits add, free-map blocks for all of those, and the inode.
+int
+writeblocks(uint n)
+{
+  uint d, ind, nmap;
+
+  d = (n + BSIZE-2) / BSIZE + 1;
+  ind = 3 * ((d + NINDIRECT-2) / NINDIRECT + 1);
+  ind += EMAXDEPTH + 2 * (d / (BSIZE/sizeof(struct extent)/2) + 1);
+  nmap = sb.size/BPB + 1;
+  return d + ind + min(d + ind, nmap) + 1;
+}
+
+// The most blocks the iput()s of one system call can log: every
+// free-map block, in case one frees a big file, and a few inode
+// blocks.
+int
+iputblocks(void)
+{
+  return sb.size/BPB + 1 + 4;
 }
 
 //PAGEBREAK!
@@ -741,7 +1203,7 @@ namex(char *path, int nameiparent, char *name)
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
   else
-    ip = idup(myproc()->cwd);
+    ip = cwdget();
 
   while((path = skipelem(path, name)) != 0){
     ilock(ip);
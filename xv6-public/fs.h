@@ -7,7 +7,7 @@
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
-//                                          free bit map | data blocks]
+//                             free bit map | data blocks | swap blocks ]
 //
 // mkfs computes the super block and builds an initial file system. The
 // super block describes the disk layout:
@@ -15,12 +15,18 @@ struct superblock {
   uint size;         // Size of file system image (blocks)
   uint nblocks;      // Number of data blocks
   uint ninodes;      // Number of inodes.
-  uint nlog;         // Number of log blocks
+  uint nlog;         // Number of log blocks, header included
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint swapstart;    // Block number of first swap block
+  uint nswap;        // Number of swap blocks
 };
 
+// Header blocks of a log of n data blocks: the count, then
+// the block numbers.
+#define LOGHEAD(n) ((sizeof(int)*((n)+1) + BSIZE-1) / BSIZE)
+
 #define NDIRECT 10
 #define NINDIRECT (BSIZE / sizeof(uint))
 #define MAXFILE (NDIRECT + NINDIRECT + (NINDIRECT*NINDIRECT) + (NINDIRECT*NINDIRECT*NINDIRECT))
@@ -35,6 +41,30 @@ struct dinode {
   uint addrs[NDIRECT+3];   // Data block addresses
 };
 
+// An inode with I_EXTENT set in its on-disk type maps its blocks
+// with extents instead: runs of file blocks that are contiguous on
+// disk too.  They are kept in a B-tree whose root fills addrs[]
+// and whose other nodes are disk blocks.  A node is an exthdr,
+// then, in a leaf (depth 0), extents, and otherwise extidx entries
+// for the nodes one level down, all in order of file block.
+#define I_EXTENT 0x100
+
+struct exthdr {
+  ushort n;             // Entries
+  ushort depth;         // 0 in a leaf
+};
+
+struct extent {
+  uint fbn;             // First file block
+  uint start;           // First disk block
+  uint len;             // Blocks
+};
+
+struct extidx {
+  uint fbn;             // First file block under blk
+  uint blk;             // Node one level down
+};
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
@@ -0,0 +1,160 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+// Futexes: sleeping on a word of user memory.  futex_wait()
+// sleeps only if the word still holds the value the caller saw,
+// checked under the lock that futex_wake() takes, so a wakeup
+// between the caller's check and its sleep is never lost.
+// Waiters are hashed by page table and address, which is the
+// same for all threads of a process.  Each waiter is a struct
+// futexw on its own kernel stack and sleeps on it, so a wakeup
+// goes to exactly the procs it is meant for.
+
+#define NFUTEX 64
+
+struct futexw {
+  pde_t *pgdir;
+  uint addr;
+  struct proc *p;
+  uint deadline;               // ticks to give up at, or 0
+  int woken;
+  struct futexw *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct futexw *head;
+  int ntimed;                  // waiters with a deadline
+} futextab[NFUTEX];
+
+void
+futexinit(void)
+{
+  int i;
+
+  for(i = 0; i < NFUTEX; i++)
+    initlock(&futextab[i].lock, "futex");
+}
+
+static int
+futexhash(pde_t *pgdir, uint addr)
+{
+  return ((uint)pgdir / PGSIZE + addr / 4) % NFUTEX;
+}
+
+// Take w off bucket b.  Caller holds its lock.
+static void
+unlinkw(int b, struct futexw *w)
+{
+  struct futexw **pp;
+
+  for(pp = &futextab[b].head; *pp; pp = &(*pp)->next)
+    if(*pp == w){
+      *pp = w->next;
+      if(w->deadline)
+        futextab[b].ntimed--;
+      return;
+    }
+}
+
+// If the word at addr is still val, sleep until futex_wake() on
+// addr, or for at most timeout ticks if timeout is not 0.
+// Returns 0 if woken, -1 if the word had changed, the time ran
+// out or the process was killed.
+int
+futex_wait_os(uint addr, int val, int timeout)
+{
+  struct proc *p = myproc();
+  struct futexw w;
+  char *ka;
+  int b, v;
+
+  if(addr % 4 != 0 || timeout < 0)
+    return -1;
+  b = futexhash(p->pgdir, addr);
+  // Read the word through the kernel mapping so that nothing
+  // faults with the lock held; fault it in and retry if needed.
+  for(;;){
+    acquire(&futextab[b].lock);
+    if((ka = uva2ka(p->pgdir, (char*)addr)) != 0)
+      break;
+    release(&futextab[b].lock);
+    if(fetchint(addr, &v) < 0)
+      return -1;
+  }
+  if(*(int*)(ka + addr % PGSIZE) != val){
+    release(&futextab[b].lock);
+    return -1;
+  }
+  w.pgdir = p->pgdir;
+  w.addr = addr;
+  w.p = p;
+  w.deadline = timeout ? ticks + timeout : 0;
+  w.woken = 0;
+  w.next = futextab[b].head;
+  futextab[b].head = &w;
+  if(w.deadline)
+    futextab[b].ntimed++;
+  // Nothing touches user memory until the wakeup (see sys_wait()).
+  p->inkernel--;
+  while(!w.woken && !p->killed && (w.deadline == 0 || ticks < w.deadline))
+    sleep(&w, &futextab[b].lock);
+  p->inkernel++;
+  if(!w.woken)
+    unlinkw(b, &w);
+  release(&futextab[b].lock);
+  return w.woken ? 0 : -1;
+}
+
+// Wake up to n procs waiting on addr.  Returns how many.
+int
+futex_wake_os(uint addr, int n)
+{
+  struct proc *p = myproc();
+  struct futexw *w, **pp;
+  int b, nwoken;
+
+  if(addr % 4 != 0)
+    return -1;
+  b = futexhash(p->pgdir, addr);
+  nwoken = 0;
+  acquire(&futextab[b].lock);
+  for(pp = &futextab[b].head; (w = *pp) != 0 && nwoken < n; ){
+    if(w->pgdir != p->pgdir || w->addr != addr){
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    if(w->deadline)
+      futextab[b].ntimed--;
+    w->woken = 1;
+    wakeupproc(w->p, w);
+    nwoken++;
+  }
+  release(&futextab[b].lock);
+  return nwoken;
+}
+
+// Wake waiters whose time ran out.  Called on every clock tick.
+void
+futextick(void)
+{
+  struct futexw *w;
+  int b;
+
+  for(b = 0; b < NFUTEX; b++){
+    if(futextab[b].ntimed == 0)
+      continue;
+    acquire(&futextab[b].lock);
+    for(w = futextab[b].head; w; w = w->next)
+      if(w->deadline && ticks >= w->deadline)
+        wakeupproc(w->p, w);
+    release(&futextab[b].lock);
+  }
+}
@@ -0,0 +1,24 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "date.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+
+int futex_wait(int *addr, int val, int timeout){
+
+	return futex_wait_os((uint)addr, val, timeout);
+}
+
+int futex_wait_w(void){
+	int *addr;
+	int val, timeout;
+
+	if(argptr(0,(char**)&addr,sizeof(*addr),0) < 0)
+	 return -1;
+	if(argint(1,&val) < 0 || argint(2,&timeout) < 0)
+	 return -1;
+	return futex_wait(addr, val, timeout);
+}
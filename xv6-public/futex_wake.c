@@ -0,0 +1,24 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "date.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+
+int futex_wake(int *addr, int n){
+
+	return futex_wake_os((uint)addr, n);
+}
+
+int futex_wake_w(void){
+	int *addr;
+	int n;
+
+	if(argptr(0,(char**)&addr,sizeof(*addr),0) < 0)
+	 return -1;
+	if(argint(1,&n) < 0)
+	 return -1;
+	return futex_wake(addr, n);
+}
@@ -0,0 +1,81 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+// futex_wait() and futex_wake(): a mutex that sleeps when it is
+// contended and stays in user space when it is not, a wait on a
+// word that has already changed, and a wait that times out.
+
+#define NTHREAD 8
+#define NITER   20000
+
+// 0 unlocked, 1 locked, 2 locked and maybe waited on.
+volatile int mutex;
+int count;
+
+void
+fail(char *msg)
+{
+  printf(1, "futextest: %s failed\n", msg);
+  exit();
+}
+
+void
+lock(volatile int *m)
+{
+  if(xchg((volatile uint*)m, 1) == 0)
+    return;
+  while(xchg((volatile uint*)m, 2) != 0)
+    futex_wait((int*)m, 2, 0);
+}
+
+void
+unlock(volatile int *m)
+{
+  if(xchg((volatile uint*)m, 0) == 2)
+    futex_wake((int*)m, 1);
+}
+
+void*
+worker(void *arg)
+{
+  int i;
+
+  for(i = 0; i < NITER; i++){
+    lock(&mutex);
+    count++;
+    unlock(&mutex);
+  }
+  thread_exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  thread_t t[NTHREAD];
+  void *ret;
+  int i, start, word;
+
+  start = uptime();
+  for(i = 0; i < NTHREAD; i++)
+    if(thread_create(&t[i], worker, 0) != 0)
+      fail("thread_create");
+  for(i = 0; i < NTHREAD; i++)
+    if(thread_join(t[i], &ret) != 0)
+      fail("thread_join");
+  if(count != NTHREAD * NITER)
+    fail("mutex");
+  printf(1, "mutex: %d threads in %d ticks: ok\n", NTHREAD, uptime() - start);
+
+  word = 1;
+  if(futex_wait(&word, 0, 0) != -1)
+    fail("wait on a changed word");
+  start = uptime();
+  if(futex_wait(&word, 1, 10) != -1 || uptime() - start < 10)
+    fail("timeout");
+  if(futex_wake(&word, 1) != 0)
+    fail("wake with no waiters");
+  printf(1, "wait and timeout: ok\n");
+  exit();
+}
@@ -15,6 +15,7 @@ main(int argc, char *argv[])
     int fd, i, j; 
     int r;
     int total;
+    int start, ticks;
     char *path = (argc > 1) ? argv[1] : "hugefile";
     char data[BUFSIZE];
     char buf[BUFSIZE];
@@ -26,6 +27,7 @@ main(int argc, char *argv[])
     }
 
     printf(1, "1. create test\n");
+    start = uptime();
     fd = open(path, O_CREATE | O_RDWR);
     for(i = 0; i < BUF_PER_FILE; i++){
         if (i % 100 == 0){
@@ -38,8 +40,12 @@ main(int argc, char *argv[])
     }
     printf(1, "%d bytes written\n", BUF_PER_FILE * BUFSIZE);
     close(fd);
+    if ((ticks = uptime() - start) == 0)
+        ticks = 1;
+    printf(1, "write: %d ticks, %d KB/s\n", ticks, FILESIZE / 1024 * 100 / ticks);
 
     printf(1, "2. read test\n");
+    start = uptime();
     fd = open(path, O_RDONLY);
     for (i = 0; i < BUF_PER_FILE; i++){
         if (i % 100 == 0){
@@ -58,6 +64,9 @@ main(int argc, char *argv[])
     }
     printf(1, "%d bytes read\n", BUF_PER_FILE * BUFSIZE);
     close(fd);
+    if ((ticks = uptime() - start) == 0)
+        ticks = 1;
+    printf(1, "read: %d ticks, %d KB/s\n", ticks, FILESIZE / 1024 * 100 / ticks);
 
     printf(1, "3. stress test\n");
     total = 0;
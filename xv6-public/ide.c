@@ -75,7 +75,7 @@ idestart(struct buf *b)
 {
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  if(b->blockno >= FSSIZE + SWAPSIZE)
     panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
@@ -118,10 +118,15 @@ ideintr(void)
   if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
     insl(0x1f0, b->data, BSIZE/4);
 
-  // Wake process waiting for this buf.
+  // Wake process waiting for this buf, or release it if
+  // nobody is waiting.
   b->flags |= B_VALID;
   b->flags &= ~B_DIRTY;
-  wakeup(b);
+  if(b->flags & B_ASYNC){
+    b->flags &= ~B_ASYNC;
+    bdone(b);
+  } else
+    wakeup(b);
 
   // Start disk on next buf in queue.
   if(idequeue != 0)
@@ -131,14 +136,40 @@ ideintr(void)
 }
 
 //PAGEBREAK!
+// Append b to idequeue, starting the disk if it is idle.
+// Caller must hold idelock.
+static void
+ideappend(struct buf *b)
+{
+  struct buf **pp;
+
+  b->qnext = 0;
+  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
+    ;
+  *pp = b;
+
+  // Start disk if necessary.
+  if(idequeue == b)
+    idestart(b);
+}
+
 // Sync buf with disk.
 // If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
 // Else if B_VALID is not set, read buf from disk, set B_VALID.
 void
 iderw(struct buf *b)
 {
-  struct buf **pp;
+  iderwstart(b);
+  iderwwait(b);
+}
 
+// Start the request iderw() would make for locked buf b, and
+// return without waiting for it.  Many requests can be started
+// and then waited for with iderwwait(), so that the disk runs
+// them back to back.
+void
+iderwstart(struct buf *b)
+{
   if(!holdingsleep(&b->lock))
     panic("iderw: buf not locked");
   if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
@@ -147,22 +178,36 @@ iderw(struct buf *b)
     panic("iderw: ide disk 1 not present");
 
   acquire(&idelock);  //DOC:acquire-lock
+  ideappend(b);
+  release(&idelock);
+}
 
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
-    ;
-  *pp = b;
-
-  // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
-
-  // Wait for request to finish.
+// Wait for the request started on b to finish.
+void
+iderwwait(struct buf *b)
+{
+  acquire(&idelock);
   while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
     sleep(b, &idelock);
   }
+  release(&idelock);
+}
 
+// Start reading locked buf b from disk and return at once.  The
+// caller hands b over: ideintr() calls bdone(b) when the data
+// is in.
+void
+idereadasync(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("idereadasync: buf not locked");
+  if(b->flags & (B_VALID|B_DIRTY))
+    panic("idereadasync: not a read");
+  if(b->dev != 0 && !havedisk1)
+    panic("idereadasync: ide disk 1 not present");
 
+  acquire(&idelock);
+  b->flags |= B_ASYNC;
+  ideappend(b);
   release(&idelock);
 }
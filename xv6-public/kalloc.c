@@ -1,6 +1,7 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, and 4 MB
+// superpages when a whole aligned 4 MB run happens to be free.
 
 #include "types.h"
 #include "defs.h"
@@ -8,62 +9,179 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "meminfo.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
                    // defined by the kernel linker script in kernel.ld
 
+uint phystop;      // top of usable physical memory, set by meminit()
+uchar *pageref;    // extra references to each physical page, see kref()
+uchar *pagetag;    // KM_ class of each allocated page
+
+// The free list is doubly linked so that kallocsuper() can pull
+// an arbitrary run of pages out of it.
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
 struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  ushort nfree[PHYSTOP/SUPERPGSIZE]; // free pages in each 4 MB chunk
+  uint total;                        // pages managed by the allocator
+  uint free;
+  uint used[NKM];                    // allocated pages by KM_ class
 } kmem;
 
+// One entry of the BIOS memory map that bootasm.S leaves at E820MAP.
+struct e820entry {
+  uint addr;
+  uint addrhi;
+  uint len;
+  uint lenhi;
+  uint type;
+};
+
+#define E820_RAM 1    // usable memory
+#define NE820   32    // more entries than this means the map is garbage
+
+// Used when there is no BIOS map, e.g. when a multiboot loader
+// started the kernel without going through bootasm.S.
+static struct e820entry e820default = { 0, 0, 0xE000000, 0, E820_RAM };
+
+static struct e820entry*
+e820map(int *n)
+{
+  *n = *(ushort*)P2V(E820MAP);
+  if(*n == 0 || *n > NE820){
+    *n = 1;
+    return &e820default;
+  }
+  return (struct e820entry*)P2V(E820MAP+4);
+}
+
+// Find the top of usable physical memory from the BIOS map.
+// Memory above PHYSTOP cannot be direct mapped and is ignored.
+void
+meminit(void)
+{
+  struct e820entry *e;
+  uint top;
+  int i, n;
+
+  e = e820map(&n);
+  phystop = 0;
+  for(i = 0; i < n; i++){
+    if(e[i].type != E820_RAM || e[i].addrhi != 0 || e[i].addr >= PHYSTOP)
+      continue;
+    top = e[i].addr + e[i].len;
+    if(e[i].lenhi != 0 || top < e[i].addr || top > PHYSTOP)
+      top = PHYSTOP;
+    if(top > phystop)
+      phystop = PGROUNDDOWN(top);
+  }
+  if(phystop < 4*1024*1024)
+    panic("meminit: not enough memory");
+}
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
 // 2. main() calls kinit2() with the rest of the physical pages
 // after installing a full page table that maps them on all cores.
+// kinit1() also takes the per-page reference counts and class
+// tags out of boot memory.
 void
 kinit1(void *vstart, void *vend)
 {
   initlock(&kmem.lock, "kmem");
   kmem.use_lock = 0;
-  freerange(vstart, vend);
+  pageref = vstart;
+  pagetag = pageref + phystop/PGSIZE;
+  if((char*)(pagetag + phystop/PGSIZE) >= (char*)vend)
+    panic("kinit1: page metadata too big");
+  memset(pageref, 0, 2*(phystop/PGSIZE));
+  freerange(pagetag + phystop/PGSIZE, vend);
 }
 
+// Only the usable ranges of the BIOS map between vstart and vend
+// are freed.  The kernel page table maps just the boot memory at
+// this point, so the rest is mapped 4 MB at a time: the page table
+// for each chunk comes out of the memory freed before it.
 void
 kinit2(void *vstart, void *vend)
 {
-  freerange(vstart, vend);
+  struct e820entry *e;
+  uint start, stop, pa, next;
+  int i, n;
+
+  e = e820map(&n);
+  for(i = 0; i < n; i++){
+    if(e[i].type != E820_RAM || e[i].addrhi != 0 || e[i].addr >= V2P(vend))
+      continue;
+    start = e[i].addr;
+    stop = e[i].addr + e[i].len;
+    if(e[i].lenhi != 0 || stop < start || stop > V2P(vend))
+      stop = V2P(vend);
+    if(start < V2P(vstart))
+      start = V2P(vstart);
+    start = PGROUNDUP(start);
+    stop = PGROUNDDOWN(stop);
+    for(pa = start; pa < stop; pa = next){
+      next = (pa + 4*1024*1024) & ~(4*1024*1024 - 1);
+      if(next > stop)
+        next = stop;
+      if(kvmmap(pa, next - pa) < 0)
+        panic("kinit2: out of memory");
+      freerange(P2V(pa), P2V(next));
+    }
+  }
   kmem.use_lock = 1;
+  cprintf("kinit2: %d MB of physical memory\n", phystop >> 20);
 }
 
+// Put [vstart, vend) on the free list.
 void
 freerange(void *vstart, void *vend)
 {
   char *p;
   p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
+    // Count the page as allocated so that kfree() balances.
+    kmem.total++;
+    kmem.used[KM_USER]++;
+    pagetag[V2P(p)/PGSIZE] = KM_USER;
     kfree(p);
+  }
 }
 //PAGEBREAK: 21
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// If kref() added references to the page, just drop one.
 void
 kfree(char *v)
 {
   struct run *r;
 
-  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+  if((uint)v % PGSIZE || v < end || V2P(v) >= phystop)
     panic("kfree");
 
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(pageref[V2P(v)/PGSIZE] > 0){
+    pageref[V2P(v)/PGSIZE]--;
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    return;
+  }
+  if(kmem.use_lock)
+    release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
@@ -71,26 +189,126 @@ kfree(char *v)
     acquire(&kmem.lock);
   r = (struct run*)v;
   r->next = kmem.freelist;
+  r->prev = 0;
+  if(kmem.freelist)
+    kmem.freelist->prev = r;
   kmem.freelist = r;
+  kmem.nfree[V2P(v)/SUPERPGSIZE]++;
+  kmem.free++;
+  kmem.used[pagetag[V2P(v)/PGSIZE]]--;
   if(kmem.use_lock)
     release(&kmem.lock);
 }
 
-// Allocate one 4096-byte page of physical memory.
+// Allocate one 4096-byte page of physical memory for the
+// KM_ class tag, which is only used for accounting.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
 char*
-kalloc(void)
+kalloc(int tag)
 {
   struct run *r;
 
   if(kmem.use_lock)
     acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    if(r->next)
+      r->next->prev = 0;
+    kmem.nfree[V2P(r)/SUPERPGSIZE]--;
+    kmem.free--;
+    kmem.used[tag]++;
+    pagetag[V2P(r)/PGSIZE] = tag;
+  }
   if(kmem.use_lock)
     release(&kmem.lock);
   return (char*)r;
 }
 
+// Add a reference to page v, which must be allocated, so that
+// it is freed only after one more kfree().  Used for pages
+// mapped into several page tables.  Returns -1 if the page
+// already has too many references.
+int
+kref(char *v)
+{
+  int r;
+
+  if((uint)v % PGSIZE || v < end || V2P(v) >= phystop)
+    panic("kref");
+  r = 0;
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(pageref[V2P(v)/PGSIZE] == 255)
+    r = -1;
+  else
+    pageref[V2P(v)/PGSIZE]++;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+  return r;
+}
+
+// Allocate one physically contiguous, 4 MB-aligned superpage.
+// Returns 0 if no aligned 4 MB chunk is entirely free; callers
+// are expected to fall back to ordinary pages.
+char*
+kallocsuper(void)
+{
+  struct run *r;
+  char *v;
+  uint i;
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  for(i = 1; i < phystop/SUPERPGSIZE; i++)
+    if(kmem.nfree[i] == SUPERPGSIZE/PGSIZE)
+      break;
+  if(i >= phystop/SUPERPGSIZE){
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    return 0;
+  }
+  v = P2V(i*SUPERPGSIZE);
+  for(r = (struct run*)v; (char*)r < v + SUPERPGSIZE; r = (struct run*)((char*)r + PGSIZE)){
+    if(r->prev)
+      r->prev->next = r->next;
+    else
+      kmem.freelist = r->next;
+    if(r->next)
+      r->next->prev = r->prev;
+  }
+  kmem.nfree[i] = 0;
+  kmem.free -= SUPERPGSIZE/PGSIZE;
+  kmem.used[KM_USER] += SUPERPGSIZE/PGSIZE;
+  memset(&pagetag[i*SUPERPGSIZE/PGSIZE], KM_USER, SUPERPGSIZE/PGSIZE);
+  if(kmem.use_lock)
+    release(&kmem.lock);
+  return v;
+}
+
+// Free a superpage returned by kallocsuper().
+void
+kfreesuper(char *v)
+{
+  char *p;
+
+  if((uint)v % SUPERPGSIZE)
+    panic("kfreesuper");
+  for(p = v; p < v + SUPERPGSIZE; p += PGSIZE)
+    kfree(p);
+}
+
+// Fill in the page allocator's part of *mi.
+void
+kmeminfo(struct meminfo *mi)
+{
+  int i;
+
+  acquire(&kmem.lock);
+  mi->total = kmem.total;
+  mi->free = kmem.free;
+  for(i = 0; i < NKM; i++)
+    mi->used[i] = kmem.used[i];
+  release(&kmem.lock);
+}
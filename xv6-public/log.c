@@ -5,6 +5,9 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "mmu.h"
+#include "proc.h"
+#include "meminfo.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -18,192 +21,449 @@
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the commit thread has taken the transaction.
+// end_op() waits for the commit only if its call logged a block;
+// one that changed nothing, such as an iput() that does not free
+// the inode, returns at once.
+// begin_op() reserves room for MAXOPBLOCKS blocks; a call that
+// knows it writes fewer says so with begin_opn(n).  Each block
+// that log_write() adds to the transaction comes out of the
+// reservation, and end_op() gives back what is left, so a new
+// call waits only if the blocks logged so far plus those still
+// reserved leave no room for it.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
+//   header blocks, containing the count n and then
+//     block #s for block A, B, C, ...
 //   block A
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+//
+// Commits are done by the commit thread, committer(), one
+// transaction at a time, for every system call that has ended in
+// it: end_op() just waits for its transaction to commit (group
+// commit).  To take the open transaction, the commit thread keeps
+// new system calls out until those in progress have ended, and
+// copies the transaction's blocks from the cache into its own
+// buffers.  Then it opens the next transaction, and writes the
+// log, the header -- the commit point -- and the home locations
+// from those copies while new system calls go on in the cache.
+// A block stays pinned in the cache with B_DIRTY until it is
+// home, which limits the dirty buffers to the open transaction and
+// the one being committed.
+//
+// The log is as big as mkfs made it, up to LOGSIZE blocks.  The
+// header takes as many blocks as it needs; the first, which holds
+// n, is written last, so that writing it is still the commit point.
+//
+// Unless LOGDATA is set, file data does not go through the log
+// (ordered mode): writei() hands its blocks to log_data(), and the
+// commit thread writes them in place, along with the log, before
+// it writes the header.  So a committed inode never points at data
+// that is not on disk, while the data is written only once.  The
+// blocks still take room in the transaction, for their copies.
+// Data written in place is not undone by a crash before the commit,
+// so a block freed in a transaction must not be reused until that
+// transaction has committed: until then a committed inode may still
+// point at it, as data or as an indirect block or extent node, and
+// after a crash would read whatever was written there.  The log keeps
+// the free map as last committed, and balloc() takes only blocks
+// that are free in it too (see log_inuse()).  An overwrite of a
+// block a file already has can still be seen in part after a crash.
 
-// Contents of the header block, used for both the on-disk header block
+// Contents of the header blocks, used for both the on-disk header
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
   int block[LOGSIZE];
 };
 
+#define NBMAP (FSSIZE/BPB + 1)  // free map blocks that log_inuse() covers
+
 struct log {
   struct spinlock lock;
   int start;
-  int size;
+  int nhead;       // header blocks
+  int size;        // data blocks
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // blocks they may still add to lh and ld
+  int closing;     // committer() is waiting to take lh, please wait.
+  int nwait;       // sys calls in end_op() waiting for commit
   int dev;
-  struct logheader lh;
+  struct logheader lh;  // the open transaction
+  struct logheader ld;  // and its file data, written in place
+  uint seq;             // and its number
+  uint ncommitted;      // transactions committed
+  struct logheader ch;  // the transaction being committed
+  struct logheader cd;  // and its file data
+  struct buf *wbuf[LOGSIZE]; // copies of the blocks of ch, then cd
+  uint bmapstart;       // free map, as of the last commit
+  int nbmap;
+  uchar *bmap[NBMAP];
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
+static void committer(void);
 
 void
 initlog(int dev)
 {
-  if (sizeof(struct logheader) >= BSIZE)
-    panic("initlog: too big logheader");
-
   struct superblock sb;
+  struct buf *b;
+  char *mem = 0, *bufs = 0;
+  int i, nperpage;
+
   initlock(&log.lock, "log");
   readsb(dev, &sb);
   log.start = sb.logstart;
-  log.size = sb.nlog;
   log.dev = dev;
+  // As many data blocks as fit with their header.
+  log.size = sb.nlog - 1;
+  if(log.size > LOGSIZE)
+    log.size = LOGSIZE;
+  while(log.size + LOGHEAD(log.size) > sb.nlog)
+    log.size--;
+  log.nhead = LOGHEAD(log.size);
+  if(log.size < 2*MAXOPBLOCKS)
+    panic("initlog: log too small");
+
+  nperpage = PGSIZE / sizeof(struct buf);
+  for(i = 0; i < log.size; i++){
+    if(i % nperpage == 0 && (bufs = kalloc(KM_BUF)) == 0)
+      panic("initlog: out of memory");
+    if(i % (PGSIZE/BSIZE) == 0 && (mem = kalloc(KM_BUF)) == 0)
+      panic("initlog: out of memory");
+    log.wbuf[i] = (struct buf*)bufs + i % nperpage;
+    memset(log.wbuf[i], 0, sizeof(struct buf));
+    log.wbuf[i]->data = (uchar*)mem + (i % (PGSIZE/BSIZE))*BSIZE;
+    initsleeplock(&log.wbuf[i]->lock, "logwbuf");
+  }
   recover_from_log();
+
+  // The free map as recovery left it, which is what is committed.
+  log.bmapstart = sb.bmapstart;
+  log.nbmap = sb.size/BPB + 1;
+  if(log.nbmap > NBMAP)
+    panic("initlog: free map too big");
+  for(i = 0; i < log.nbmap; i++){
+    if(i % (PGSIZE/BSIZE) == 0 && (mem = kalloc(KM_BUF)) == 0)
+      panic("initlog: out of memory");
+    log.bmap[i] = (uchar*)mem + (i % (PGSIZE/BSIZE))*BSIZE;
+    b = bread(dev, sb.bmapstart + i);
+    memmove(log.bmap[i], b->data, BSIZE);
+    brelse(b);
+  }
+  if(kthread("commit", committer) < 0)
+    panic("initlog: committer");
 }
 
-// Copy committed blocks from log to their home location
+// Start reading or writing the copies w of the blocks of h from
+// or to the log, if tolog, or else their home locations.  The
+// copies bypass the cache.
 static void
-install_trans(void)
+iostart(struct logheader *h, struct buf **w, int tolog, int write)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    brelse(lbuf);
-    brelse(dbuf);
+  for (tail = 0; tail < h->n; tail++) {
+    acquiresleep(&w[tail]->lock);
+    w[tail]->dev = log.dev;
+    w[tail]->blockno = tolog ? log.start+log.nhead+tail : h->block[tail];
+    w[tail]->flags = write ? B_DIRTY : 0;
+    iderwstart(w[tail]);
   }
 }
 
+// Wait for the requests of iostart() on copies w[0..n-1].
+static void
+iowait(struct buf **w, int n)
+{
+  int tail;
+
+  for (tail = 0; tail < n; tail++) {
+    iderwwait(w[tail]);
+    releasesleep(&w[tail]->lock);
+  }
+}
+
+// Read or write the copies of h, all started before any is
+// waited for, so the disk runs them back to back.
+static void
+copyio(struct logheader *h, int tolog, int write)
+{
+  iostart(h, log.wbuf, tolog, write);
+  iowait(log.wbuf, h->n);
+}
+
+// Copy the blocks of h from the cache into w.
+static void
+copyin(struct logheader *h, struct buf **w)
+{
+  int tail;
+  struct buf *b;
+
+  for (tail = 0; tail < h->n; tail++) {
+    b = bread(log.dev, h->block[tail]);
+    memmove(w[tail]->data, b->data, BSIZE);
+    brelse(b);
+  }
+}
+
+#define HPB (BSIZE/sizeof(int))  // header words per block
+
 // Read the log header from disk into the in-memory log header
 static void
 read_head(void)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
-  int i;
-  log.lh.n = lh->n;
+  struct buf *buf;
+  int i, k;
+
+  buf = bread(log.dev, log.start);
+  log.lh.n = ((int*)buf->data)[0];
+  if (log.lh.n < 0 || log.lh.n > log.size)
+    panic("read_head: bad log");
+  // Word i+1 of the header is block[i].
   for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+    k = (i+1) / HPB;
+    if ((i+1) % HPB == 0) {
+      brelse(buf);
+      buf = bread(log.dev, log.start+k);
+    }
+    log.lh.block[i] = ((int*)buf->data)[(i+1) % HPB];
   }
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
+// Write in-memory log header h to disk.
 // This is the true point at which the
-// current transaction commits.
+// current transaction commits: the first block,
+// with the count, goes last.
 static void
-write_head(void)
+write_head(struct logheader *h)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
-  int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  struct buf *buf;
+  int i, k, nb;
+
+  nb = LOGHEAD(h->n);
+  for (k = nb-1; k >= 0; k--) {
+    buf = bread(log.dev, log.start+k);
+    for (i = k*HPB; i < (k+1)*HPB && i <= h->n; i++)
+      ((int*)buf->data)[i - k*HPB] = i == 0 ? h->n : h->block[i-1];
+    bwrite(buf);
+    brelse(buf);
   }
-  bwrite(buf);
-  brelse(buf);
 }
 
 static void
 recover_from_log(void)
 {
   read_head();
-  install_trans(); // if committed, copy from log to disk
+  copyio(&log.lh, 1, 0); // if committed, copy from log
+  copyio(&log.lh, 0, 1); // to disk
   log.lh.n = 0;
-  write_head(); // clear the log
+  write_head(&log.lh); // clear the log
 }
 
-// called at the start of each FS system call.
+// The index of block blockno in h, or -1.
+static int
+inlog(struct logheader *h, int blockno)
+{
+  int i;
+
+  for (i = 0; i < h->n; i++)
+    if (h->block[i] == blockno)
+      return i;
+  return -1;
+}
+
+// The blocks of h, with copies w, have committed: keep the free
+// map blocks among them for log_inuse().  Caller holds log.lock.
+static void
+bmapcommit(struct logheader *h, struct buf **w)
+{
+  int i, k;
+
+  for (i = 0; i < h->n; i++) {
+    k = h->block[i] - log.bmapstart;
+    if (k >= 0 && k < log.nbmap)
+      memmove(log.bmap[k], w[i]->data, BSIZE);
+  }
+}
+
+// Whether block b is in use in the free map as last committed.
+// A block that the open transaction, or the one being committed,
+// has freed still is, and balloc() passes it over.
+int
+log_inuse(uint b)
+{
+  int r;
+
+  acquire(&log.lock);
+  r = (log.bmap[b/BPB][(b%BPB)/8] & (1 << (b%8))) != 0;
+  release(&log.lock);
+  return r;
+}
+
+// The blocks of h are home: let the cache evict them, unless
+// the open transaction has changed them again.
+static void
+unpin(struct logheader *h)
+{
+  struct buf *b;
+  int i;
+
+  for (i = 0; i < h->n; i++) {
+    b = bread(log.dev, h->block[i]);
+    acquire(&log.lock);
+    if (inlog(&log.lh, b->blockno) < 0 && inlog(&log.ld, b->blockno) < 0)
+      b->flags &= ~B_DIRTY;
+    release(&log.lock);
+    brelse(b);
+  }
+}
+
+// called at the start of each FS system call that
+// writes at most n blocks.
 void
-begin_op(void)
+begin_opn(int n)
 {
+  if(n > MAXOPBLOCKS)
+    panic("begin_opn");
   acquire(&log.lock);
   while(1){
-    if(log.committing){
+    if(log.closing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
+    } else if(log.lh.n + log.ld.n + log.reserved + n > log.size){
+      // this op might exhaust log space; wait for commit,
+      // or, if nothing is logged yet, for ops to end.
+      if(log.lh.n + log.ld.n > 0){
+        log.closing = 1;
+        wakeup(&log.closing);
+      }
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += n;
+      myproc()->logres = n;
       release(&log.lock);
       break;
     }
   }
 }
 
+// called at the start of each FS system call.
+void
+begin_op(void)
+{
+  begin_opn(MAXOPBLOCKS);
+}
+
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// waits until the transaction it was part of has committed,
+// if it changed anything.
 void
 end_op(void)
 {
-  int do_commit = 0;
+  uint seq;
+  int logged;
 
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
-  } else {
-    // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
+  // begin_op() may be waiting for log space,
+  // and giving back what is left of this op's
+  // reservation has made some.
+  log.reserved -= myproc()->logres;
+  myproc()->logres = 0;
+  logged = myproc()->logged;
+  myproc()->logged = 0;
+  wakeup(&log);
+  if(!logged){
+    // nothing of ours to commit.
+    if(log.outstanding == 0)
+      wakeup(&log.closing);
+    release(&log.lock);
+    return;
   }
+  seq = log.seq;
+  log.nwait++;
+  wakeup(&log.closing);
+  while(log.ncommitted <= seq)
+    sleep(&log.ncommitted, &log.lock);
+  log.nwait--;
   release(&log.lock);
+}
+
+// The commit thread.  Takes the open transaction once a system
+// call in it has ended or it is full, then commits and installs
+// it.
+static void
+committer(void)
+{
+  static struct logheader empty;
+  uint seq;
+
+  for(;;){
+    acquire(&log.lock);
+    while(log.lh.n + log.ld.n == 0 || (log.nwait == 0 && !log.closing))
+      sleep(&log.closing, &log.lock);
+    log.closing = 1;
+    while(log.outstanding > 0)
+      sleep(&log.closing, &log.lock);
+    release(&log.lock);
+
+    // No sys call can change lh, ld or their blocks now.
+    copyin(&log.lh, log.wbuf);
+    copyin(&log.ld, log.wbuf + log.lh.n);
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
     acquire(&log.lock);
-    log.committing = 0;
+    log.ch = log.lh;
+    log.cd = log.ld;
+    seq = log.seq++;
+    log.lh.n = log.ld.n = 0;
+    log.closing = 0;
     wakeup(&log);
     release(&log.lock);
-  }
-}
 
-// Copy modified blocks from cache to log.
-static void
-write_log(void)
-{
-  int tail;
+    // Write the copies to the log, and the data in place
+    iostart(&log.ch, log.wbuf, 1, 1);
+    iostart(&log.cd, log.wbuf + log.ch.n, 0, 1);
+    iowait(log.wbuf, log.ch.n + log.cd.n);
+    write_head(&log.ch);   // Write header to disk -- the real commit
+    acquire(&log.lock);
+    bmapcommit(&log.ch, log.wbuf);
+    log.ncommitted = seq + 1;
+    wakeup(&log.ncommitted);
+    release(&log.lock);
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+    copyio(&log.ch, 0, 1); // Now install writes to home locations
+    write_head(&empty);    // Erase the transaction from the log
+    unpin(&log.ch);
+    unpin(&log.cd);
   }
 }
 
+// Add a new block to the open transaction, out of the caller's
+// reservation.  Caller holds log.lock.
 static void
-commit()
-{
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
-  }
+charge(void)
+{
+  if (log.lh.n + log.ld.n >= log.size)
+    panic("too big a transaction");
+  // One that has used up its reservation can only take
+  // unreserved space.
+  if (myproc()->logres > 0) {
+    myproc()->logres--;
+    log.reserved--;
+  } else if (log.lh.n + log.ld.n + log.reserved >= log.size)
+    panic("log_write: over reservation");
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache with B_DIRTY.
-// commit()/write_log() will do the disk write.
+// committer() will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -215,22 +475,43 @@ log_write(struct buf *b)
 {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
-    panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
   acquire(&log.lock);
-  for (i = 0; i < log.lh.n; i++) {
-    if (log.lh.block[i] == b->blockno){   // log absorbtion      
-      break;
-    }
-  }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n){
-    log.lh.n++;
+  if (inlog(&log.lh, b->blockno) < 0) {   // else log absorbtion
+    // A block of file data that now holds metadata moves to
+    // the log, in the room it already had.
+    if ((i = inlog(&log.ld, b->blockno)) >= 0)
+      log.ld.block[i] = log.ld.block[--log.ld.n];
+    else
+      charge();
+    log.lh.block[log.lh.n++] = b->blockno;
   }
+  myproc()->logged = 1;
   b->flags |= B_DIRTY; // prevent eviction
   release(&log.lock);
 }
 
+// log_write() for a block of file data.  In ordered mode the block
+// is written in place before the transaction commits, not logged,
+// unless it is logged already.
+void
+log_data(struct buf *b)
+{
+  if (LOGDATA) {
+    log_write(b);
+    return;
+  }
+  if (log.outstanding < 1)
+    panic("log_data outside of trans");
+
+  acquire(&log.lock);
+  if (inlog(&log.lh, b->blockno) < 0 && inlog(&log.ld, b->blockno) < 0) {
+    charge();
+    log.ld.block[log.ld.n++] = b->blockno;
+  }
+  myproc()->logged = 1;
+  b->flags |= B_DIRTY; // prevent eviction
+  release(&log.lock);
+}
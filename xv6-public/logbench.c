@@ -0,0 +1,84 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+
+// Small file system transactions from 1 to NWRITER processes at
+// once: each write() below is one system call that returns once
+// its transaction has committed, and concurrent ones share commits.
+
+#define NWRITE  512
+#define NWRITER 8
+
+char buf[BSIZE];
+char name[] = "logbench.0";
+
+void
+fail(char *msg)
+{
+  printf(1, "logbench: %s failed\n", msg);
+  exit();
+}
+
+// Write n blocks to a file of its own.
+void
+writer(int me, int n)
+{
+  int fd, i;
+
+  name[9] = '0' + me;
+  if((fd = open(name, O_CREATE|O_RDWR)) < 0)
+    fail("create");
+  for(i = 0; i < n; i++){
+    memset(buf, i, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write");
+  }
+  close(fd);
+}
+
+// Check what writer(me, n) wrote and remove it.
+void
+check(int me, int n)
+{
+  int fd, i;
+
+  name[9] = '0' + me;
+  if((fd = open(name, O_RDONLY)) < 0)
+    fail("open");
+  for(i = 0; i < n; i++)
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf) || buf[0] != (char)i)
+      fail("read back");
+  close(fd);
+  unlink(name);
+}
+
+int
+main(int argc, char *argv[])
+{
+  static int nwriters[] = { 1, 2, 4, 8 };
+  int i, j, n, pid, start, ticks;
+
+  for(i = 0; i < sizeof(nwriters)/sizeof(nwriters[0]); i++){
+    n = nwriters[i];
+    start = uptime();
+    for(j = 0; j < n; j++){
+      if((pid = fork()) < 0)
+        fail("fork");
+      if(pid == 0){
+        writer(j, NWRITE / n);
+        exit();
+      }
+    }
+    for(j = 0; j < n; j++)
+      wait();
+    if((ticks = uptime() - start) == 0)
+      ticks = 1;
+    printf(1, "%d writers\t%d ticks\t%d tx/sec\n", n, ticks,
+           NWRITE * 100 / ticks);
+    for(j = 0; j < n; j++)
+      check(j, NWRITE / n);
+  }
+  exit();
+}
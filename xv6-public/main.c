@@ -5,6 +5,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "x86.h"
+#include "meminfo.h"
 
 static void startothers(void);
 static void mpmain(void)  __attribute__((noreturn));
@@ -17,6 +18,7 @@ extern char end[]; // first address after kernel loaded from ELF file
 int
 main(void)
 {
+  meminit();       // size physical memory
   kinit1(end, P2V(4*1024*1024)); // phys page allocator
   kvmalloc();      // kernel page table
   mpinit();        // detect other processors
@@ -30,9 +32,13 @@ main(void)
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
+  mmapinit();      // mmap regions
+  shminit();       // shared memory segments
+  pcacheinit();    // pages of MAP_SHARED files
+  futexinit();     // futex wait table
   ideinit();       // disk 
   startothers();   // start other processors
-  kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  kinit2(P2V(4*1024*1024), P2V(phystop)); // must come after startothers()
   userinit();      // first user process
   mpmain();        // finish this processor's setup
 }
@@ -81,7 +87,7 @@ startothers(void)
     // Tell entryother.S what stack to use, where to enter, and what
     // pgdir to use. We cannot use kpgdir yet, because the AP processor
     // is running in low  memory, so we use entrypgdir for the APs too.
-    stack = kalloc();
+    stack = kalloc(KM_KSTACK);
     *(void**)(code-4) = stack + KSTACKSIZE;
     *(void**)(code-8) = mpenter;
     *(int**)(code-12) = (void *) V2P(entrypgdir);
@@ -0,0 +1,215 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+// Allocation throughput of malloc() against the K&R allocator it
+// replaced, with 1 and with NTHREAD threads.  Each thread keeps a
+// window of NSLOT live blocks and replaces a random one per step,
+// mostly with small sizes and now and then a large one.  The K&R
+// allocator is not thread-safe, so it runs under one global lock,
+// which is how a program would have had to use it.
+
+#define NTHREAD 10
+#define NSLOT   64
+#define NSTEP   20000
+
+typedef long Align;
+
+union header {
+  struct {
+    union header *ptr;
+    uint size;
+  } s;
+  Align x;
+};
+
+typedef union header Header;
+
+static Header base;
+static Header *freep;
+static volatile uint krlock;
+
+void
+krfree(void *ap)
+{
+  Header *bp, *p;
+
+  bp = (Header*)ap - 1;
+  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
+    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
+      break;
+  if(bp + bp->s.size == p->s.ptr){
+    bp->s.size += p->s.ptr->s.size;
+    bp->s.ptr = p->s.ptr->s.ptr;
+  } else
+    bp->s.ptr = p->s.ptr;
+  if(p + p->s.size == bp){
+    p->s.size += bp->s.size;
+    p->s.ptr = bp->s.ptr;
+  } else
+    p->s.ptr = bp;
+  freep = p;
+}
+
+static Header*
+morecore(uint nu)
+{
+  char *p;
+  Header *hp;
+
+  if(nu < 4096)
+    nu = 4096;
+  p = sbrk(nu * sizeof(Header));
+  if(p == (char*)-1)
+    return 0;
+  hp = (Header*)p;
+  hp->s.size = nu;
+  krfree((void*)(hp + 1));
+  return freep;
+}
+
+void*
+krmalloc(uint nbytes)
+{
+  Header *p, *prevp;
+  uint nunits;
+
+  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  if((prevp = freep) == 0){
+    base.s.ptr = freep = prevp = &base;
+    base.s.size = 0;
+  }
+  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
+    if(p->s.size >= nunits){
+      if(p->s.size == nunits)
+        prevp->s.ptr = p->s.ptr;
+      else {
+        p->s.size -= nunits;
+        p += p->s.size;
+        p->s.size = nunits;
+      }
+      freep = prevp;
+      return (void*)(p + 1);
+    }
+    if(p == freep)
+      if((p = morecore(nunits)) == 0)
+        return 0;
+  }
+}
+
+void*
+lockedkrmalloc(uint n)
+{
+  void *p;
+
+  while(xchg(&krlock, 1) != 0)
+    ;
+  p = krmalloc(n);
+  xchg(&krlock, 0);
+  return p;
+}
+
+void
+lockedkrfree(void *p)
+{
+  while(xchg(&krlock, 1) != 0)
+    ;
+  krfree(p);
+  xchg(&krlock, 0);
+}
+
+struct allocator {
+  char *name;
+  void *(*alloc)(uint);
+  void (*free)(void*);
+};
+
+struct allocator allocators[] = {
+  { "k&r", lockedkrmalloc, lockedkrfree },
+  { "malloc", malloc, free },
+};
+
+struct allocator *cur;
+char *slots[NTHREAD][NSLOT];
+char *big[8];
+volatile int failed;
+
+void*
+worker(void *arg)
+{
+  char **slot;
+  uint rnd, n;
+  int i, j;
+
+  slot = slots[(int)arg];
+  rnd = (int)arg * 7919 + 1;
+  for(i = 0; i < NSTEP; i++){
+    rnd = rnd * 1103515245 + 12345;
+    j = (rnd >> 16) % NSLOT;
+    if(slot[j])
+      cur->free(slot[j]);
+    n = (rnd >> 8) % 256 == 0 ? 8192 : 8 + (rnd >> 4) % 500;
+    if((slot[j] = cur->alloc(n)) == 0){
+      failed = 1;
+      break;
+    }
+    slot[j][0] = slot[j][n-1] = i;
+  }
+  for(j = 0; j < NSLOT; j++){
+    if(slot[j])
+      cur->free(slot[j]);
+    slot[j] = 0;
+  }
+  thread_exit(0);
+}
+
+int
+run(struct allocator *a, int nthread)
+{
+  thread_t t[NTHREAD];
+  void *ret;
+  int i, start, ticks;
+
+  cur = a;
+  start = uptime();
+  for(i = 0; i < nthread; i++){
+    if(thread_create(&t[i], worker, (void*)i) != 0){
+      printf(1, "mallocbench: thread_create failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < nthread; i++)
+    thread_join(t[i], &ret);
+  ticks = uptime() - start;
+  if(failed){
+    printf(1, "mallocbench: %s ran out of memory\n", a->name);
+    exit();
+  }
+  if(ticks == 0)
+    ticks = 1;
+  printf(1, "%s\t%d threads\t%d ticks\t%d ops/sec\n", a->name, nthread,
+         ticks, nthread * NSTEP * 100 / ticks);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *top;
+  int i;
+
+  for(i = 0; i < sizeof(allocators)/sizeof(allocators[0]); i++){
+    run(&allocators[i], 1);
+    run(&allocators[i], NTHREAD);
+  }
+
+  // Large frees at the top of the heap go back to the kernel.
+  top = sbrk(0);
+  for(i = 0; i < 8; i++)
+    big[i] = malloc(64*1024);
+  for(i = 0; i < 8; i++)
+    free(big[i]);
+  printf(1, "heap grew by %d KB after 512 KB of frees\n", (sbrk(0) - top) / 1024);
+  exit();
+}
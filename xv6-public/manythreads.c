@@ -0,0 +1,105 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "meminfo.h"
+
+// Thousands of threads alive at once, in two passes so that the
+// second reuses the tids and stack slots of the first; then the
+// same joined with thread_join_any().
+
+#define NTHREAD 2000
+
+struct procmem pm[NPROC];
+thread_t t[NTHREAD];
+volatile int go;
+char seen[NTHREAD];
+
+void
+fail(char *msg)
+{
+  printf(1, "manythreads: %s failed\n", msg);
+  exit();
+}
+
+void*
+waiter(void *arg)
+{
+  while(!go)
+    yield();
+  thread_exit(arg);
+}
+
+// Threads of this process, as meminfo() counts them.
+int
+nthread(void)
+{
+  struct meminfo mi;
+  int i, n, pid;
+
+  pid = getpid();
+  n = meminfo(&mi, pm, NPROC);
+  for(i = 0; i < n; i++)
+    if(pm[i].pid == pid)
+      return pm[i].nthread;
+  fail("meminfo");
+  return 0;
+}
+
+void
+pass(void)
+{
+  void *ret;
+  int i, start;
+
+  go = 0;
+  start = uptime();
+  for(i = 0; i < NTHREAD; i++)
+    if(thread_create(&t[i], waiter, (void*)i) != 0)
+      fail("thread_create");
+  if(nthread() != NTHREAD)
+    fail("thread count");
+  go = 1;
+  // Newest first, the worst order for a linear search.
+  for(i = NTHREAD - 1; i >= 0; i--)
+    if(thread_join(t[i], &ret) != 0 || ret != (void*)i)
+      fail("thread_join");
+  if(nthread() != 0)
+    fail("thread count after join");
+  printf(1, "%d threads in %d ticks: ok\n", NTHREAD, uptime() - start);
+}
+
+void
+anypass(void)
+{
+  thread_t tid;
+  void *ret;
+  int i, start;
+
+  go = 0;
+  start = uptime();
+  for(i = 0; i < NTHREAD; i++)
+    if(thread_create(&t[i], waiter, (void*)i) != 0)
+      fail("thread_create");
+  go = 1;
+  for(i = 0; i < NTHREAD; i++){
+    if(thread_join_any(&tid, &ret) != 0)
+      fail("thread_join_any");
+    if((int)ret < 0 || (int)ret >= NTHREAD || seen[(int)ret] || t[(int)ret] != tid)
+      fail("thread_join_any result");
+    seen[(int)ret] = 1;
+  }
+  if(thread_join_any(&tid, &ret) != -1)
+    fail("thread_join_any with no threads");
+  printf(1, "%d threads joined in any order in %d ticks: ok\n", NTHREAD,
+         uptime() - start);
+}
+
+int
+main(int argc, char *argv[])
+{
+  pass();
+  pass();
+  anypass();
+  exit();
+}
@@ -0,0 +1,39 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "date.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "meminfo.h"
+
+// Fill in *mi with the system-wide memory use and up to n entries
+// of pm with the memory use of each process.  Returns the number
+// of entries of pm filled in.
+int meminfo(struct meminfo *mi, struct procmem *pm, int n){
+
+	struct meminfo k;
+
+	memset(&k, 0, sizeof(k));
+	kmeminfo(&k);
+	swapinfo(&k);
+	bcacheinfo(&k);
+	if(umemmove(mi, &k, sizeof(k)) < 0)
+	 return -1;
+	if(n <= 0)
+	 return 0;
+	return procmeminfo(pm, n);
+}
+
+int meminfo_w(void){
+	struct meminfo *mi;
+	struct procmem *pm;
+	int n;
+
+	if(argint(2,&n) < 0 || n < 0 || n > NPROC)
+	 return -1;
+	if(argptr(0,(char**)&mi,sizeof(*mi),1) < 0 || argptr(1,(char**)&pm,n*sizeof(*pm),1) < 0)
+	 return -1;
+	return meminfo(mi, pm, n);
+}
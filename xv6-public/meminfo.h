@@ -0,0 +1,32 @@
+// Page allocator classes: every kalloc() says what the page is for.
+#define KM_PGTABLE  0   // page directories and page tables
+#define KM_KSTACK   1   // kernel stacks
+#define KM_USER     2   // user memory
+#define KM_PIPE     3   // pipe buffers
+#define KM_BUF      4   // buffer cache
+#define KM_SHM      5   // shared memory and MAP_SHARED file pages
+#define KM_PROC     6   // process table and thread tables
+#define NKM         7
+
+// System-wide memory use, in pages.
+struct meminfo {
+  uint total;        // pages managed by the page allocator
+  uint free;         // free pages
+  uint used[NKM];    // allocated pages by class
+  uint swaptotal;    // swap slots
+  uint swapused;     // swap slots in use
+  uint nbuf;         // buffer cache size in blocks
+  uint bufhits;      // buffer cache lookups that found the block
+  uint bufmisses;    // and that had to read it
+};
+
+// Memory use of one process (threads are counted with it).
+struct procmem {
+  int pid;
+  int state;         // enum procstate
+  int nthread;       // threads besides the process itself
+  uint sz;           // size of the image below the heap top (bytes)
+  uint rss;          // resident user pages
+  uint swapped;      // user pages out on swap
+  char name[16];
+};
@@ -1,12 +1,15 @@
 // Memory layout
 
 #define EXTMEM  0x100000            // Start of extended memory
-#define PHYSTOP 0xE000000           // Top physical memory
+#define PHYSTOP 0x7E000000          // Top physical memory the kernel can map
 #define DEVSPACE 0xFE000000         // Other devices are at high addresses
+#define E820MAP 0x8000              // BIOS memory map left by bootasm.S
 
 // Key addresses for address space layout (see kmap in vm.c for layout)
 #define KERNBASE 0x80000000         // First kernel virtual address
 #define KERNLINK (KERNBASE+EXTMEM)  // Address where kernel is linked
+#define MMAPBASE 0x40000000         // mmap() regions go between here and TSTACKBASE
+#define TSTACKBASE 0x70000000       // Thread stacks go between here and KERNBASE
 
 #define V2P(a) (((uint) (a)) - KERNBASE)
 #define P2V(a) (((void *) (a)) + KERNBASE)
@@ -18,11 +18,12 @@
 #define NINODES 200
 
 // Disk layout:
-// [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
+// [ boot block | sb block | log | inode blocks | free bit map | data blocks |
+//   swap blocks ]
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog = LOGSIZE + LOGHEAD(LOGSIZE);
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -101,13 +102,15 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.swapstart = xint(FSSIZE);
+  sb.nswap = xint(SWAPSIZE);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d swap %d\n",
+         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE, SWAPSIZE);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
-  for(i = 0; i < FSSIZE; i++)
+  for(i = 0; i < FSSIZE + SWAPSIZE; i++)
     wsect(i, zeroes);
 
   memset(buf, 0, sizeof(buf));
@@ -227,6 +230,8 @@ ialloc(ushort type)
   struct dinode din;
 
   bzero(&din, sizeof(din));
+  if(EXTENTS && type == T_FILE)
+    type |= I_EXTENT;
   din.type = xshort(type);
   din.nlink = xshort(1);
   din.size = xint(0);
@@ -238,20 +243,63 @@ void
 balloc(int used)
 {
   uchar buf[BSIZE];
-  int i;
+  int i, b;
 
   printf("balloc: first %d blocks have been allocated\n", used);
-  assert(used < BSIZE*8);
-  bzero(buf, BSIZE);
-  for(i = 0; i < used; i++){
-    buf[i/8] = buf[i/8] | (0x1 << (i%8));
+  assert(used < nbitmap*BSIZE*8);
+  for(b = 0; b*BSIZE*8 < used; b++){
+    bzero(buf, BSIZE);
+    for(i = 0; i < BSIZE*8 && b*BSIZE*8 + i < used; i++){
+      buf[i/8] = buf[i/8] | (0x1 << (i%8));
+    }
+    printf("balloc: write bitmap block at sector %d\n", sb.bmapstart+b);
+    wsect(sb.bmapstart+b, buf);
   }
-  printf("balloc: write bitmap block at sector %d\n", sb.bmapstart);
-  wsect(sb.bmapstart, buf);
 }
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return entry i of indirect block bn, allocating it if needed.
+uint
+indirect(uint bn, uint i)
+{
+  uint a[NINDIRECT];
+
+  rsect(bn, (char*)a);
+  if(a[i] == 0){
+    a[i] = xint(freeblock++);
+    wsect(bn, (char*)a);
+  }
+  return xint(a[i]);
+}
+
+// Return block fbn of extent inode din, allocating it if needed.
+// Files get their blocks in order, one file at a time, so each is
+// a single extent in the root.
+uint
+extent(struct dinode *din, uint fbn)
+{
+  struct exthdr *h = (struct exthdr*)din->addrs;
+  struct extent *e = (struct extent*)(h + 1);
+  int i, n;
+
+  n = xshort(h->n);
+  for(i = 0; i < n; i++)
+    if(fbn >= xint(e[i].fbn) && fbn < xint(e[i].fbn) + xint(e[i].len))
+      return xint(e[i].start) + fbn - xint(e[i].fbn);
+  if(n > 0 && xint(e[n-1].fbn) + xint(e[n-1].len) == fbn &&
+     xint(e[n-1].start) + xint(e[n-1].len) == freeblock){
+    e[n-1].len = xint(xint(e[n-1].len) + 1);
+    return freeblock++;
+  }
+  assert(sizeof(*h) + (n+1)*sizeof(*e) <= sizeof(din->addrs));
+  e[n].fbn = xint(fbn);
+  e[n].start = xint(freeblock);
+  e[n].len = xint(1);
+  h->n = xshort(n+1);
+  return freeblock++;
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -259,7 +307,6 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
@@ -268,21 +315,25 @@ iappend(uint inum, void *xp, int n)
   while(n > 0){
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
+    if(xshort(din.type) & I_EXTENT){
+      x = extent(&din, fbn);
+    } else if(fbn < NDIRECT){
       if(xint(din.addrs[fbn]) == 0){
         din.addrs[fbn] = xint(freeblock++);
       }
       x = xint(din.addrs[fbn]);
-    } else {
+    } else if(fbn < NDIRECT + NINDIRECT){
       if(xint(din.addrs[NDIRECT]) == 0){
         din.addrs[NDIRECT] = xint(freeblock++);
       }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
+      x = indirect(xint(din.addrs[NDIRECT]), fbn - NDIRECT);
+    } else {
+      // Double indirect, as in bmap().
+      if(xint(din.addrs[NDIRECT+1]) == 0){
+        din.addrs[NDIRECT+1] = xint(freeblock++);
       }
-      x = xint(indirect[fbn-NDIRECT]);
+      x = fbn - NDIRECT - NINDIRECT;
+      x = indirect(indirect(xint(din.addrs[NDIRECT+1]), x / NINDIRECT), x % NINDIRECT);
     }
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
@@ -0,0 +1,11 @@
+#define PROT_READ     0x1  // pages may be read
+#define PROT_WRITE    0x2  // pages may be written
+
+#define MAP_SHARED    0x01 // writes go back to the file
+#define MAP_PRIVATE   0x02 // writes stay in this process
+#define MAP_ANONYMOUS 0x04 // zero-filled memory, no file
+
+#define MAP_FAILED ((void*)-1)
+
+#define IPC_PRIVATE   0     // shmget() key: always a new segment
+#define IPC_CREAT     0x200 // shmget() flag: create if key is unused
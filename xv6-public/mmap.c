@@ -0,0 +1,724 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "date.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "mman.h"
+
+// mmap() regions are placed top-down between MMAPBASE and TSTACKBASE.
+// No memory is allocated up front: pages are filled in by
+// mmapfault() the first time the process touches them, from the
+// file (through the buffer cache) or with zeros.  MAP_SHARED file
+// regions map the file's pages in the page cache instead (see
+// pcache.c), shared with every other mapping of the file and kept
+// coherent with read() and write().  Shared memory segments
+// (see shm.c) are attached as regions too; their pages are shared
+// with other processes rather than copied.
+//
+// Thread stacks live between TSTACKBASE and KERNBASE.  Thread tid
+// gets a slot of p->tstack + TGUARDSIZE bytes there: its stack at
+// the top, which behaves like an anonymous region and so grows by
+// faults, and an unmapped guard gap below it.
+
+// Each address space's faults and vma table changes are serialized
+// by a sleep lock of its own, the vmalocked flag of its vmaproc().
+// vmafill() drops it while it waits for the disk.
+static struct spinlock vmalk; // protects every proc's vmalocked
+
+void
+mmapinit(void)
+{
+  initlock(&vmalk, "vma");
+}
+
+static void
+lockvma(struct proc *p)
+{
+  acquire(&vmalk);
+  while(p->vmalocked)
+    sleep(&p->vmalocked, &vmalk);
+  p->vmalocked = 1;
+  release(&vmalk);
+}
+
+static void
+unlockvma(struct proc *p)
+{
+  acquire(&vmalk);
+  p->vmalocked = 0;
+  wakeup(&p->vmalocked);
+  release(&vmalk);
+}
+
+// Wait until no vmafill() has the lock dropped, so that regions
+// can be changed or freed.  Caller holds p's vma lock.
+static void
+vmaidle(struct proc *p)
+{
+  acquire(&vmalk);
+  while(p->vmafills > 0){
+    p->vmalocked = 0;
+    wakeup(&p->vmalocked);
+    sleep(&p->vmafills, &vmalk);
+    while(p->vmalocked)
+      sleep(&p->vmalocked, &vmalk);
+    p->vmalocked = 1;
+  }
+  release(&vmalk);
+}
+
+// Threads run in their creator's address space, so they also
+// use its vma table and its size.
+struct proc*
+vmaproc(struct proc *p)
+{
+  while(p->tid != 0 && p->parent)
+    p = p->parent;
+  return p;
+}
+
+static struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NMMAP]; v++)
+    if(v->len && va >= v->addr && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
+// Is va in a MAP_SHARED region of p?  Those pages are not swapped.
+int
+mmapshared(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  v = findvma(vmaproc(p), va);
+  return v && (v->flags & MAP_SHARED);
+}
+
+// Lowest address used by mmap regions; the heap must stay below it.
+uint
+mmapbase(struct proc *p)
+{
+  struct vma *v;
+  uint base;
+
+  p = vmaproc(p);
+  base = TSTACKBASE;
+  for(v = p->vma; v < &p->vma[NMMAP]; v++)
+    if(v->len && v->addr < base)
+      base = v->addr;
+  return base;
+}
+
+// Find len free bytes for a new region, as high as possible.
+// Returns 0 if there is no room.
+static uint
+findgap(struct proc *p, uint len)
+{
+  struct vma *v;
+  uint a, low;
+
+  low = MMAPBASE;
+  if(PGROUNDUP(p->sz) > low)
+    low = PGROUNDUP(p->sz);
+  if(len > TSTACKBASE - low)
+    return 0;
+  a = TSTACKBASE - len;
+again:
+  for(v = p->vma; v < &p->vma[NMMAP]; v++){
+    if(v->len && a < v->addr + v->len && v->addr < a + len){
+      if(v->addr < low + len)
+        return 0;
+      a = v->addr - len;
+      goto again;
+    }
+  }
+  return a;
+}
+
+// Top of thread tid's stack in p, or 0 if the slot does not fit.
+uint
+stacktop(struct proc *p, int tid)
+{
+  uint slot;
+
+  p = vmaproc(p);
+  slot = p->tstack + TGUARDSIZE;
+  if(tid < 1 || tid > (KERNBASE - TSTACKBASE) / slot)
+    return 0;
+  return KERNBASE - (tid - 1) * slot;
+}
+
+// If va is in the stack of a live thread of p, describe that
+// stack as a region in *v.  Guard gaps are in no region.
+static struct vma*
+findstack(struct proc *p, uint va, struct vma *v)
+{
+  uint tid;
+
+  if(va < TSTACKBASE || va >= KERNBASE)
+    return 0;
+  tid = (KERNBASE - 1 - va) / (p->tstack + TGUARDSIZE) + 1;
+  if(threadproc(p, tid) == 0 || stacktop(p, tid) == 0)
+    return 0;
+  memset(v, 0, sizeof(*v));
+  v->addr = stacktop(p, tid) - p->tstack;
+  v->len = p->tstack;
+  v->prot = PROT_READ|PROT_WRITE;
+  v->flags = MAP_PRIVATE|MAP_ANONYMOUS;
+  return va >= v->addr ? v : 0;
+}
+
+// The region holding va: an mmap region or a thread stack, which
+// is described in *tmp.
+static struct vma*
+lookup(struct proc *p, uint va, struct vma *tmp)
+{
+  struct vma *v;
+
+  if((v = findvma(p, va)) != 0)
+    return v;
+  return findstack(p, va, tmp);
+}
+
+// Back the page at va in region v with memory.  Caller holds
+// p's vma lock, which is dropped while the page is read in from
+// the file or swap, so v must be looked up again afterwards.
+static int
+vmafill(struct proc *p, struct vma *v, uint va)
+{
+  struct vma tmp;
+  struct file *f;
+  pte_t *pte;
+  char *mem;
+  uint off;
+  int perm, shared, r;
+
+  va = PGROUNDDOWN(va);
+  if((pte = walkpgdir(p->pgdir, (char*)va, 0)) != 0 && (*pte & PTE_P))
+    return 0;
+  if(pte && (*pte & PTE_SWAP)){
+    unlockvma(p);
+    r = swapin(p->pgdir, va);
+    lockvma(p);
+    return r;
+  }
+  if(v->shm){
+    if((mem = shmpage(v->shm, v->off + (va - v->addr))) == 0)
+      return -1;
+  } else {
+    // Regions stay put until vmafills drops (see vmaidle()).
+    f = v->f;
+    shared = f && (v->flags & MAP_SHARED);
+    off = v->off + (va - v->addr);
+    p->vmafills++;
+    unlockvma(p);
+    if(shared)
+      mem = pcachepage(f->ip, off);
+    else if((mem = swapalloc()) != 0){
+      memset(mem, 0, PGSIZE);
+      if(f){
+        ilock(f->ip);
+        // Past the end of the file the page stays zero.
+        if(off < f->ip->size && readi(f->ip, mem, off, PGSIZE) < 0){
+          kfree(mem);
+          mem = 0;
+        }
+        iunlock(f->ip);
+      }
+    }
+    lockvma(p);
+    acquire(&vmalk);
+    if(--p->vmafills == 0)
+      wakeup(&p->vmafills);
+    release(&vmalk);
+    // A thread stack may have gone, and another thread may
+    // have filled the page meanwhile.
+    if(mem && (v = lookup(p, va, &tmp)) == 0){
+      kfree(mem);
+      mem = 0;
+    }
+    if(mem == 0)
+      return -1;
+    pte = walkpgdir(p->pgdir, (char*)va, 0);
+    if(pte && (*pte & (PTE_P|PTE_SWAP))){
+      kfree(mem);
+      return 0;
+    }
+  }
+  perm = PTE_U;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Free the pages of region v in [start, end), marking those a
+// MAP_SHARED file region changed in the page cache.  Caller holds
+// p's vma lock.
+static void
+vmaunmap(struct proc *p, struct vma *v, uint start, uint end)
+{
+  pte_t *pte;
+  uint a;
+  int pass;
+
+  // Other threads may still be using the pages through their
+  // TLBs, so first take the PTEs away, keeping the page
+  // addresses, then flush, then free the pages.
+  for(pass = 0; pass < 2; pass++){
+    if(pass == 1)
+      tlbflush(p->pgdir);
+    for(a = start; a < end; a += PGSIZE){
+      if((pte = walkpgdir(p->pgdir, (char*)a, 0)) == 0){
+        a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+        continue;
+      }
+      if(*pte & PTE_SWAP){
+        swapfree(*pte);
+        *pte = 0;
+      }
+      if(pass == 0){
+        *pte &= ~PTE_P;
+        continue;
+      }
+      if(*pte == 0)
+        continue;
+      if(v->f && (v->flags & MAP_SHARED) && (*pte & PTE_D))
+        pcachedirty(v->f->ip, v->off + (a - v->addr));
+      kfree(P2V(PTE_ADDR(*pte)));
+      *pte = 0;
+    }
+  }
+}
+
+static void
+vmafree(struct vma *v)
+{
+  if(v->f && (v->flags & MAP_SHARED))
+    pcacheput(v->f->ip);
+  if(v->f)
+    fileclose(v->f);
+  if(v->shm)
+    shmrelease(v->shm);
+  v->f = 0;
+  v->shm = 0;
+  v->len = 0;
+}
+
+// Handle a page fault at va by the current process.
+// Returns 0 if the page is now mapped, -1 if the access is bad.
+int
+mmapfault(uint va, int write)
+{
+  struct proc *p;
+  struct vma *v, tmp;
+  int r;
+
+  p = vmaproc(myproc());
+  r = -1;
+  lockvma(p);
+  if((v = lookup(p, va, &tmp)) != 0 && (!write || (v->prot & PROT_WRITE)))
+    r = vmafill(p, v, va);
+  unlockvma(p);
+  return r;
+}
+
+// Check that [addr, addr+len) lies in mmap regions or thread
+// stacks of the current process, writable ones if write is set,
+// and fault it all in, so system calls can use it directly.
+int
+mmapuser(uint addr, uint len, int write)
+{
+  struct proc *p;
+  struct vma *v, tmp;
+  uint a;
+  int r;
+
+  if(addr + len < addr)
+    return -1;
+  p = vmaproc(myproc());
+  r = 0;
+  lockvma(p);
+  if(lookup(p, addr, &tmp) == 0)
+    r = -1;
+  for(a = PGROUNDDOWN(addr); r == 0 && a < addr + len; a += PGSIZE)
+    if((v = lookup(p, a, &tmp)) == 0 ||
+       (write && !(v->prot & PROT_WRITE)) || vmafill(p, v, a) < 0)
+      r = -1;
+  unlockvma(p);
+  return r;
+}
+
+// fetchstr() for strings in mmap regions and thread stacks.
+int
+mmapstr(uint addr, char **pp)
+{
+  struct proc *p;
+  struct vma *v, tmp;
+  uint s;
+
+  p = vmaproc(myproc());
+  lockvma(p);
+  if((v = lookup(p, addr, &tmp)) == 0){
+    unlockvma(p);
+    return -1;
+  }
+  *pp = (char*)addr;
+  for(s = addr; ; s++){
+    // vmafill() may drop the lock, so look the region up again.
+    if((s == addr || s % PGSIZE == 0) &&
+       ((v = lookup(p, s, &tmp)) == 0 || vmafill(p, v, s) < 0))
+      break;
+    if(*(char*)s == 0){
+      unlockvma(p);
+      return s - addr;
+    }
+  }
+  unlockvma(p);
+  return -1;
+}
+
+// Copy the pages of region v faulted in so far from p to np,
+// except that segment and page cache pages are shared.  Caller
+// holds p's vma lock.
+static int
+vmacopy(struct proc *p, struct proc *np, struct vma *v)
+{
+  pte_t *pte;
+  char *mem;
+  uint a;
+
+  for(a = v->addr; a < v->addr + v->len; a += PGSIZE){
+    if((pte = walkpgdir(p->pgdir, (char*)a, 0)) == 0){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if((*pte & (PTE_P|PTE_SWAP)) == 0)
+      continue;
+    if(v->shm || (v->f && (v->flags & MAP_SHARED))){
+      mem = P2V(PTE_ADDR(*pte));
+      if(kref(mem) < 0)
+        return -1;
+    } else {
+      if((mem = swapalloc()) == 0)
+        return -1;
+      if(*pte & PTE_SWAP)
+        swapread(*pte, mem);
+      else
+        memmove(mem, P2V(PTE_ADDR(*pte)), PGSIZE);
+    }
+    if(mappages(np->pgdir, (char*)a, PGSIZE, V2P(mem), PTE_FLAGS(*pte) & ~PTE_SWAP) < 0){
+      kfree(mem);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Give child np curproc's mmap regions.  Pages faulted in so far
+// are copied, except that segment and page cache pages are shared.
+int
+mmapfork(struct proc *curproc, struct proc *np)
+{
+  struct proc *p;
+  struct vma *v, tmp;
+  int i;
+
+  p = vmaproc(curproc);
+  lockvma(p);
+  // A thread that forks takes the pages of its stack along; the
+  // child holds its tid (see fork()).
+  if(curproc->tid != 0 &&
+     (v = findstack(p, curproc->tf->esp, &tmp)) != 0 &&
+     vmacopy(p, np, v) < 0)
+    goto bad;
+  curproc = p;
+  for(v = curproc->vma; v < &curproc->vma[NMMAP]; v++)
+    if(v->len && vmacopy(curproc, np, v) < 0)
+      goto bad;
+  for(i = 0; i < NMMAP; i++){
+    np->vma[i] = curproc->vma[i];
+    if(np->vma[i].len && np->vma[i].f)
+      filedup(np->vma[i].f);
+    if(np->vma[i].len && np->vma[i].f && (np->vma[i].flags & MAP_SHARED))
+      pcachedup(np->vma[i].f->ip);
+    if(np->vma[i].len && np->vma[i].shm)
+      shmdup(np->vma[i].shm);
+  }
+  unlockvma(p);
+  return 0;
+
+bad:
+  unlockvma(p);
+  return -1;
+}
+
+// Fault in the top page of thread tid's stack, so that
+// thread_create() can put the arguments there.
+int
+stackalloc(struct proc *p, int tid)
+{
+  struct vma *v, tmp;
+  int r;
+
+  p = vmaproc(p);
+  r = -1;
+  lockvma(p);
+  if((v = findstack(p, stacktop(p, tid) - 1, &tmp)) != 0)
+    r = vmafill(p, v, stacktop(p, tid) - PGSIZE);
+  unlockvma(p);
+  return r;
+}
+
+// Free the stack of thread tid, which must have exited.
+void
+stackfree(struct proc *p, int tid)
+{
+  struct vma *v, tmp;
+
+  p = vmaproc(p);
+  lockvma(p);
+  if((v = findstack(p, stacktop(p, tid) - 1, &tmp)) != 0)
+    vmaunmap(p, v, v->addr, v->addr + v->len);
+  unlockvma(p);
+}
+
+// Unmap every region of p, writing back shared file pages.
+// Called by exit() and by exec() before the old image goes away.
+void
+mmapexit(struct proc *p)
+{
+  struct vma *v, gone[NMMAP];
+  int n;
+
+  if(p->tid != 0)
+    return;
+  n = 0;
+  lockvma(p);
+  vmaidle(p);
+  for(v = p->vma; v < &p->vma[NMMAP]; v++){
+    if(v->len == 0)
+      continue;
+    vmaunmap(p, v, v->addr, v->addr + v->len);
+    gone[n++] = *v;
+    v->len = 0;
+  }
+  unlockvma(p);
+  // Writing back the page cache takes inode locks, which a
+  // fault may be waiting under, so do it unlocked.
+  while(n > 0)
+    vmafree(&gone[--n]);
+}
+
+// Add a region of len bytes to the current process.  Takes its
+// own references to f; shm's and f's page cache's are handed over.
+// Returns the region's address, or 0 if there is no room.
+static uint
+vmaadd(uint len, int prot, int flags, struct file *f, struct shmseg *shm, uint off)
+{
+  struct proc *p;
+  struct vma *v;
+  uint a;
+
+  p = vmaproc(myproc());
+  lockvma(p);
+  for(v = p->vma; v < &p->vma[NMMAP]; v++)
+    if(v->len == 0)
+      break;
+  if(v == &p->vma[NMMAP] || (a = findgap(p, len)) == 0){
+    unlockvma(p);
+    return 0;
+  }
+  v->addr = a;
+  v->len = len;
+  v->prot = prot;
+  v->flags = flags;
+  v->f = f ? filedup(f) : 0;
+  v->shm = shm;
+  v->off = off;
+  unlockvma(p);
+  return a;
+}
+
+// Map length bytes of the file open as fd, starting at offset,
+// or zeroed memory if flags has MAP_ANONYMOUS.  addr is only a
+// hint and is currently ignored.  Returns the start of the region.
+int
+mmap(uint addr, int length, int prot, int flags, int fd, int offset)
+{
+  struct shmseg *shm;
+  struct file *f;
+  uint len, a;
+
+  if(length <= 0 || offset < 0 || offset % PGSIZE != 0)
+    return -1;
+  if((prot & PROT_READ) == 0 || (prot & ~(PROT_READ|PROT_WRITE)) != 0)
+    return -1;
+  if(((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0))
+    return -1;
+  f = 0;
+  if((flags & MAP_ANONYMOUS) == 0){
+    if((f = fdfile(fd)) == 0)
+      return -1;
+    if(f->type != FD_INODE || !f->readable ||
+       ((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)){
+      fileclose(f);
+      return -1;
+    }
+  }
+
+  len = PGROUNDUP((uint)length);
+  shm = 0;
+  if((flags & (MAP_SHARED|MAP_ANONYMOUS)) == (MAP_SHARED|MAP_ANONYMOUS)){
+    // Shared with children after fork(), so back it with a segment.
+    if((shm = shmanon(len)) == 0)
+      return -1;
+  }
+  if(f && (flags & MAP_SHARED)){
+    // The page cache only holds offsets below KERNBASE.
+    if(offset + len > KERNBASE || offset + len < len || pcachemap(f->ip) < 0){
+      fileclose(f);
+      return -1;
+    }
+  }
+  a = vmaadd(len, prot, flags, f, shm, offset);
+  if(a == 0 && f && (flags & MAP_SHARED))
+    pcacheput(f->ip);
+  if(f)
+    fileclose(f);
+  if(a == 0){
+    if(shm)
+      shmrelease(shm);
+    return -1;
+  }
+  return a;
+}
+
+// Attach shared memory segment id.  Returns the region's address.
+int
+shmat_os(int id)
+{
+  struct shmseg *shm;
+  uint size, a;
+
+  if((shm = shmget_os(id, &size)) == 0)
+    return -1;
+  if((a = vmaadd(size, PROT_READ|PROT_WRITE, MAP_SHARED, 0, shm, 0)) == 0){
+    shmrelease(shm);
+    return -1;
+  }
+  return a;
+}
+
+// Detach the segment attached at addr.
+int
+shmdt_os(uint addr)
+{
+  struct proc *p;
+  struct vma *v;
+  uint len;
+
+  p = vmaproc(myproc());
+  lockvma(p);
+  v = findvma(p, addr);
+  len = (v && v->shm && v->addr == addr) ? v->len : 0;
+  unlockvma(p);
+  if(len == 0)
+    return -1;
+  return munmap_os(addr, len);
+}
+
+// Remove the mappings for [addr, addr+length), which may cover
+// parts of several regions or split one region in two.
+int
+munmap_os(uint addr, int length)
+{
+  struct proc *p;
+  struct vma *v, *nv, gone[NMMAP];
+  uint end, s, e;
+  int n;
+
+  if(addr % PGSIZE != 0 || length <= 0)
+    return -1;
+  end = addr + PGROUNDUP((uint)length);
+  if(end < addr || end > TSTACKBASE)
+    return -1;
+
+  p = vmaproc(myproc());
+  n = 0;
+  lockvma(p);
+  vmaidle(p);
+  // Punching a hole needs a spare slot; find it before changing anything.
+  nv = 0;
+  for(v = p->vma; v < &p->vma[NMMAP]; v++)
+    if(v->len && v->addr < addr && v->addr + v->len > end)
+      break;
+  if(v < &p->vma[NMMAP]){
+    for(nv = p->vma; nv < &p->vma[NMMAP]; nv++)
+      if(nv->len == 0)
+        break;
+    if(nv == &p->vma[NMMAP]){
+      unlockvma(p);
+      return -1;
+    }
+  }
+
+  for(v = p->vma; v < &p->vma[NMMAP]; v++){
+    if(v->len == 0 || v == nv || end <= v->addr || v->addr + v->len <= addr)
+      continue;
+    s = v->addr > addr ? v->addr : addr;
+    e = v->addr + v->len < end ? v->addr + v->len : end;
+    vmaunmap(p, v, s, e);
+    if(s == v->addr && e == v->addr + v->len){
+      gone[n++] = *v;
+      v->len = 0;
+    } else if(s == v->addr){
+      v->off += e - v->addr;
+      v->len -= e - v->addr;
+      v->addr = e;
+    } else if(e == v->addr + v->len){
+      v->len = s - v->addr;
+    } else {
+      *nv = *v;
+      nv->addr = e;
+      nv->len = v->addr + v->len - e;
+      nv->off = v->off + (e - v->addr);
+      if(nv->f)
+        filedup(nv->f);
+      if(nv->f && (nv->flags & MAP_SHARED))
+        pcachedup(nv->f->ip);
+      if(nv->shm)
+        shmdup(nv->shm);
+      v->len = s - v->addr;
+    }
+  }
+  unlockvma(p);
+  // As in mmapexit().
+  while(n > 0)
+    vmafree(&gone[--n]);
+  return 0;
+}
+
+int mmap_w(void){
+	int addr, length, prot, flags, fd, offset;
+
+	if(argint(0,&addr) < 0 || argint(1,&length) < 0 || argint(2,&prot) < 0)
+	 return -1;
+	if(argint(3,&flags) < 0 || argint(4,&fd) < 0 || argint(5,&offset) < 0)
+	 return -1;
+	return mmap((uint)addr, length, prot, flags, fd, offset);
+}
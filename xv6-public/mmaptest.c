@@ -0,0 +1,189 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mman.h"
+
+#define FILESIZE (64*1024)
+
+char *filepath = "mmapfile";
+char buf[512];
+
+void
+fail(char *msg)
+{
+  printf(1, "mmaptest: %s failed\n", msg);
+  exit();
+}
+
+void
+makefile(void)
+{
+  int fd, i, j;
+
+  fd = open(filepath, O_CREATE | O_RDWR);
+  if(fd < 0)
+    fail("create");
+  for(i = 0; i < FILESIZE; i += sizeof(buf)){
+    for(j = 0; j < sizeof(buf); j++)
+      buf[j] = (i + j) % 251;
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write");
+  }
+  close(fd);
+}
+
+void
+anontest(void)
+{
+  char *p;
+  int i, pid;
+
+  printf(1, "1. anonymous mapping\n");
+  p = mmap(0, 1024*1024, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(p == MAP_FAILED)
+    fail("anonymous mmap");
+  for(i = 0; i < 1024*1024; i += 4096)
+    if(p[i] != 0)
+      fail("zero fill");
+  for(i = 0; i < 1024*1024; i += 4096)
+    p[i] = i / 4096;
+  pid = fork();
+  if(pid == 0){
+    for(i = 0; i < 1024*1024; i += 4096)
+      if(p[i] != (char)(i / 4096))
+        fail("fork copy");
+    exit();
+  }
+  wait();
+  // Punch a hole; the pages around it must survive.
+  if(munmap(p + 8*4096, 4*4096) < 0)
+    fail("munmap hole");
+  if(p[7*4096] != 7 || p[12*4096] != 12)
+    fail("pages around hole");
+  if(munmap(p, 1024*1024) < 0)
+    fail("munmap");
+}
+
+void
+filetest(void)
+{
+  char *p, *q;
+  int fd, i, pid;
+
+  printf(1, "2. private file mapping\n");
+  fd = open(filepath, O_RDONLY);
+  p = mmap(0, FILESIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == MAP_FAILED)
+    fail("private mmap");
+  for(i = 0; i < FILESIZE; i++)
+    if(p[i] != (char)(i % 251))
+      fail("private contents");
+  p[0] = 'x';
+  munmap(p, FILESIZE);
+  if(read(fd, buf, 1) != 1 || buf[0] != 0)
+    fail("private write leaked to file");
+  close(fd);
+
+  printf(1, "3. shared file mapping\n");
+  fd = open(filepath, O_RDWR);
+  p = mmap(0, FILESIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 4096);
+  if(p == MAP_FAILED)
+    fail("shared mmap");
+  for(i = 0; i < FILESIZE - 4096; i += 4096)
+    p[i] = 'y';
+  // Past the end of the file: readable, but never written back.
+  if(p[FILESIZE - 4096] != 0)
+    fail("zero past end of file");
+  if(write(fd, p + 1, 100) != 100)
+    fail("write from mapping");
+  // Other mappings, children and read() see stores at once, and
+  // the mappings see write()s.
+  q = mmap(0, FILESIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 4096);
+  if(q == MAP_FAILED)
+    fail("second shared mmap");
+  if(q[0] != 'y' || pread(fd, buf, 1, 4096) != 1 || buf[0] != 'y')
+    fail("store seen through the file");
+  if(pwrite(fd, "z", 1, 2*4096) != 1 || p[4096] != 'z')
+    fail("write seen through a mapping");
+  pid = fork();
+  if(pid == 0){
+    q[4096 + 1] = 'c';
+    exit();
+  }
+  wait();
+  if(p[4096 + 1] != 'c')
+    fail("store by child");
+  munmap(q, FILESIZE);
+  munmap(p, FILESIZE);
+  close(fd);
+  fd = open(filepath, O_RDONLY);
+  for(i = 0; i < FILESIZE; i += 4096){
+    if(pread(fd, buf, 2, i) != 2)
+      fail("pread");
+    if(i >= 4096 && buf[0] != (i == 2*4096 ? 'z' : 'y'))
+      fail("shared write-back");
+  }
+  if(pread(fd, buf, 2, 2*4096) != 2 || buf[1] != 'c')
+    fail("child's store written back");
+  close(fd);
+
+  printf(1, "4. read-only mapping\n");
+  fd = open(filepath, O_RDONLY);
+  p = mmap(0, FILESIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(p == MAP_FAILED)
+    fail("read-only mmap");
+  if(read(fd, p, 100) != -1 || pread(fd, p, 100, 0) != -1)
+    fail("read into read-only mapping");
+  munmap(p, FILESIZE);
+  close(fd);
+}
+
+int pfd[2];
+char *rbuf;
+
+void*
+reader(void *arg)
+{
+  rbuf[0] = 0;
+  thread_exit((void*)read(pfd[0], rbuf, 10));
+}
+
+// A read() into a page that another thread unmaps while the read
+// sleeps fails instead of crashing the kernel.
+void
+unmaptest(void)
+{
+  thread_t t;
+  void *ret;
+
+  printf(1, "5. unmapped under a read\n");
+  if(pipe(pfd) < 0)
+    fail("pipe");
+  rbuf = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(rbuf == MAP_FAILED)
+    fail("mmap");
+  if(thread_create(&t, reader, 0) != 0)
+    fail("thread_create");
+  sleep(10);
+  if(munmap(rbuf, 4096) < 0)
+    fail("munmap");
+  if(write(pfd[1], "0123456789", 10) != 10)
+    fail("pipe write");
+  if(thread_join(t, &ret) != 0 || (int)ret != -1)
+    fail("read into unmapped page");
+  close(pfd[0]);
+  close(pfd[1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  makefile();
+  anontest();
+  filetest();
+  unmaptest();
+  unlink(filepath);
+  printf(1, "mmap test ok\n");
+  exit();
+}
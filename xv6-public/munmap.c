@@ -0,0 +1,24 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "date.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+
+int munmap(uint addr, int length){
+
+	return munmap_os(addr, length);
+}
+
+int munmap_w(void){
+	int addr;
+	int length;
+
+	if(argint(0,&addr) < 0)
+	 return -1;
+	if(argint(1,&length) < 0)
+	 return -1;
+	return munmap((uint)addr, length);
+}
@@ -1,14 +1,25 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      4096  // maximum number of processes and threads
+#define NPIDHASH    256  // buckets of the pid hash
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
+#define NMMAP        16  // mmap() regions per process
+#define TSTACKSIZE (64*1024)  // default stack reserved for each thread
+#define TGUARDSIZE (16*1024)  // unmapped gap below each thread stack
+#define TLSSIZE      64  // thread-local block at the top of each thread stack
+#define NSHM         32  // shared memory segments per system
+#define NPCACHE      32  // files with MAP_SHARED regions per system
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
-#define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define MAXPATH     128  // maximum file path name
+#define MAXOPBLOCKS  64  // max # of blocks any FS op writes
+#define LOGSIZE    2000  // max data blocks in on-disk log
+#define NBUF       (2*LOGSIZE + 3*MAXOPBLOCKS)  // least size of disk block cache
+#define LOGDATA       0  // 1: journal file data too, 0: write it in place
+#define EXTENTS       1  // new files map their blocks with extents
 #define FSSIZE       40000  // size of file system in blocks
+#define SWAPSIZE     65536  // blocks of swap space after the file system
 #define NSTRIDE	   20000  // maximum number of stride_table
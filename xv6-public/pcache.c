@@ -0,0 +1,233 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "meminfo.h"
+
+// Pages of files with MAP_SHARED mappings.  While any region maps
+// a file, its pages are kept here, one copy per file offset, and
+// every process mapping a page maps that copy and holds a kref()
+// on it, as with shared memory segments (see shm.c).  readi() and
+// writei() go through cached pages too, so stores into a mapping
+// are seen by read() and other mappings at once, and write()s by
+// the mappings.  The PTE_D of a process's PTE is moved to the
+// cached page's when the process unmaps it; once the last region
+// mapping the file is gone, the pages so marked are written back
+// and all are freed.
+
+struct pcache {
+  struct inode *ip;            // File cached; 0 if slot unused
+  int nmap;                    // Regions mapping it
+  pde_t *pgdir;                // Its pages by offset; PTE_D if changed
+  struct sleeplock lock;       // One pcacheput() writing back at a time
+};
+
+// lock protects the slots, nmap and the PTE_D bits.  The pages
+// themselves and ip->pc change only with the inode locked.
+struct {
+  struct spinlock lock;
+  struct pcache pc[NPCACHE];
+} pcache;
+
+void
+pcacheinit(void)
+{
+  struct pcache *pc;
+
+  initlock(&pcache.lock, "pcache");
+  for(pc = pcache.pc; pc < &pcache.pc[NPCACHE]; pc++)
+    initsleeplock(&pc->lock, "pcache");
+}
+
+// Count a new MAP_SHARED region of ip, caching its pages from now
+// on.  Returns -1 if there is no free slot.
+int
+pcachemap(struct inode *ip)
+{
+  struct pcache *pc;
+  pde_t *pgdir;
+
+  if((pgdir = (pde_t*)kalloc(KM_PGTABLE)) == 0)
+    return -1;
+  memset(pgdir, 0, PGSIZE);
+  ilock(ip);
+  acquire(&pcache.lock);
+  if(ip->pc){
+    ip->pc->nmap++;
+    release(&pcache.lock);
+    iunlock(ip);
+    kfree((char*)pgdir);
+    return 0;
+  }
+  for(pc = pcache.pc; pc < &pcache.pc[NPCACHE]; pc++)
+    if(pc->ip == 0)
+      break;
+  if(pc == &pcache.pc[NPCACHE]){
+    release(&pcache.lock);
+    iunlock(ip);
+    kfree((char*)pgdir);
+    return -1;
+  }
+  pc->ip = ip;
+  pc->nmap = 1;
+  pc->pgdir = pgdir;
+  ip->pc = pc;
+  release(&pcache.lock);
+  iunlock(ip);
+  return 0;
+}
+
+// Count one more region mapping ip, which has some already.
+void
+pcachedup(struct inode *ip)
+{
+  acquire(&pcache.lock);
+  ip->pc->nmap++;
+  release(&pcache.lock);
+}
+
+// Return the cached page of ip at offset off, or 0.
+// Caller holds ip->lock.
+char*
+pcachefind(struct inode *ip, uint off)
+{
+  pte_t *pte;
+
+  if(ip->pc == 0 || off >= KERNBASE)
+    return 0;
+  if((pte = walkpgdir(ip->pc->pgdir, (char*)off, 0)) == 0 || (*pte & PTE_P) == 0)
+    return 0;
+  return P2V(PTE_ADDR(*pte));
+}
+
+// Return the page of ip at offset off, reading it in if it is not
+// cached yet, with a reference taken for the caller's mapping.
+// ip must be mapped.
+char*
+pcachepage(struct inode *ip, uint off)
+{
+  pte_t *pte;
+  char *mem;
+
+  if(off >= KERNBASE)
+    return 0;
+  ilock(ip);
+  if((mem = pcachefind(ip, off)) == 0){
+    if((mem = kalloc(KM_SHM)) == 0){
+      iunlock(ip);
+      return 0;
+    }
+    memset(mem, 0, PGSIZE);
+    // Past the end of the file the page stays zero.
+    if((off < ip->size && readi(ip, mem, off, PGSIZE) < 0) ||
+       (pte = walkpgdir(ip->pc->pgdir, (char*)off, 1)) == 0){
+      iunlock(ip);
+      kfree(mem);
+      return 0;
+    }
+    *pte = V2P(mem) | PTE_P | PTE_W | PTE_U;
+  }
+  if(kref(mem) < 0)
+    mem = 0;
+  iunlock(ip);
+  return mem;
+}
+
+// A mapping changed the cached page of ip at offset off.
+void
+pcachedirty(struct inode *ip, uint off)
+{
+  pte_t *pte;
+
+  acquire(&pcache.lock);
+  if((pte = walkpgdir(ip->pc->pgdir, (char*)off, 0)) != 0 && (*pte & PTE_P))
+    *pte |= PTE_D;
+  release(&pcache.lock);
+}
+
+// Copy page mem back to ip at offset off.  Never extends the file.
+static void
+pcachewrite(struct inode *ip, uint off, char *mem)
+{
+  uint i, n;
+  int max;
+
+  // Same transaction size limit as filewrite().
+  max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+  for(i = 0; i < PGSIZE; i += n){
+    n = PGSIZE - i;
+    if(n > max)
+      n = max;
+    begin_opn(writeblocks(n));
+    ilock(ip);
+    if(off + i >= ip->size){
+      iunlock(ip);
+      end_op();
+      break;
+    }
+    if(n > ip->size - off - i)
+      n = ip->size - off - i;
+    writei(ip, mem + i, off + i, n);
+    iunlock(ip);
+    end_op();
+  }
+}
+
+// A region mapping ip went away.  After the last one, write the
+// changed pages back and free them all.
+void
+pcacheput(struct inode *ip)
+{
+  struct pcache *pc;
+  pde_t *pgdir;
+  pte_t *pte;
+  uint off;
+  int dirty;
+
+  pc = ip->pc;
+  acquiresleep(&pc->lock);
+  acquire(&pcache.lock);
+  if(--pc->nmap > 0){
+    release(&pcache.lock);
+    releasesleep(&pc->lock);
+    return;
+  }
+  release(&pcache.lock);
+
+  for(off = 0; off < KERNBASE; off += PGSIZE){
+    if((pte = walkpgdir(pc->pgdir, (char*)off, 0)) == 0){
+      off = PGADDR(PDX(off) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    acquire(&pcache.lock);
+    dirty = (*pte & (PTE_P|PTE_D)) == (PTE_P|PTE_D);
+    *pte &= ~PTE_D;
+    release(&pcache.lock);
+    if(dirty)
+      pcachewrite(ip, off, P2V(PTE_ADDR(*pte)));
+  }
+
+  // Someone may have mapped the file again meanwhile.
+  pgdir = 0;
+  ilock(ip);
+  acquire(&pcache.lock);
+  if(pc->nmap == 0){
+    pgdir = pc->pgdir;
+    pc->pgdir = 0;
+    pc->ip = 0;
+    ip->pc = 0;
+  }
+  release(&pcache.lock);
+  iunlock(ip);
+  releasesleep(&pc->lock);
+  // freevm() also drops each page's reference held by the cache.
+  if(pgdir)
+    freevm(pgdir);
+}
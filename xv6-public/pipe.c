@@ -7,6 +7,7 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "meminfo.h"
 
 #define PIPESIZE 512
 
@@ -28,7 +29,7 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((p = (struct pipe*)kalloc()) == 0)
+  if((p = (struct pipe*)kalloc(KM_PIPE)) == 0)
     goto bad;
   p->readopen = 1;
   p->writeopen = 1;
@@ -90,11 +91,13 @@ pipewrite(struct pipe *p, char *addr, int n)
       wakeup(&p->nread);
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    if(umemmove(&p->data[p->nwrite % PIPESIZE], addr + i, 1) < 0)
+      break;
+    p->nwrite++;
   }
   wakeup(&p->nread);  //DOC: pipewrite-wakeup1
   release(&p->lock);
-  return n;
+  return i == n ? n : -1;
 }
 
 int
@@ -113,7 +116,11 @@ piperead(struct pipe *p, char *addr, int n)
   for(i = 0; i < n; i++){  //DOC: piperead-copy
     if(p->nread == p->nwrite)
       break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+    if(umemmove(addr + i, &p->data[p->nread % PIPESIZE], 1) < 0){
+      i = -1;
+      break;
+    }
+    p->nread++;
   }
   wakeup(&p->nwrite);  //DOC: piperead-wakeup
   release(&p->lock);
@@ -0,0 +1,78 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+// Parallel reads through the buffer cache.  1 to NTHREAD threads
+// each pread() NREAD blocks from a file of their own; the files
+// are small enough to stay cached, so every read is a bget() hit.
+// pread() holds the inode lock, so threads sharing a file would
+// measure that lock rather than the cache.
+
+#define NTHREAD 8
+#define NBLOCK  2
+#define NREAD   20000
+
+int fds[NTHREAD];
+
+void
+fail(char *msg)
+{
+  printf(1, "preadbench: %s failed\n", msg);
+  exit();
+}
+
+void*
+reader(void *arg)
+{
+  char buf[512];
+  int i, fd;
+
+  fd = fds[(int)arg];
+  for(i = 0; i < NREAD; i++)
+    if(pread(fd, buf, sizeof(buf), (i % NBLOCK) * sizeof(buf)) != sizeof(buf))
+      thread_exit((void*)1);
+  thread_exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  static int nthreads[] = { 1, 2, 4, 8 };
+  char name[] = "preadbench.0", buf[512];
+  thread_t t[NTHREAD];
+  void *ret;
+  int i, j, n, start, ticks;
+
+  for(i = 0; i < NTHREAD; i++){
+    name[11] = '0' + i;
+    if((fds[i] = open(name, O_CREATE|O_RDWR)) < 0)
+      fail("open");
+    memset(buf, i, sizeof(buf));
+    for(j = 0; j < NBLOCK; j++)
+      if(write(fds[i], buf, sizeof(buf)) != sizeof(buf))
+        fail("write");
+  }
+
+  for(i = 0; i < sizeof(nthreads)/sizeof(nthreads[0]); i++){
+    n = nthreads[i];
+    start = uptime();
+    for(j = 0; j < n; j++)
+      if(thread_create(&t[j], reader, (void*)j) != 0)
+        fail("thread_create");
+    for(j = 0; j < n; j++)
+      if(thread_join(t[j], &ret) != 0 || ret != 0)
+        fail("pread");
+    if((ticks = uptime() - start) == 0)
+      ticks = 1;
+    printf(1, "pread\t%d threads\t%d ticks\t%d reads/sec\n", n, ticks,
+           n * NREAD * 100 / ticks);
+  }
+
+  for(i = 0; i < NTHREAD; i++){
+    close(fds[i]);
+    name[11] = '0' + i;
+    unlink(name);
+  }
+  exit();
+}
@@ -6,10 +6,17 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "meminfo.h"
 
+// The process table.  Procs are carved out of pages as they are
+// needed, up to NPROC, and are never given back; unused ones wait
+// on the free list.  Procs with a pid are also hashed by it.
 struct {
   struct spinlock lock;
-  struct proc proc[NPROC];
+  struct proc *list;             // all procs, linked by next
+  struct proc *free;             // UNUSED procs, linked by hnext
+  struct proc *hash[NPIDHASH];   // procs by pid, linked by hnext
+  int nproc;                     // procs allocated
   int share;
 } ptable;
 
@@ -27,6 +34,10 @@ extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static void tidfreeall(struct proc*);
+static int tidclaim(struct proc*, uint);
+static void tidfree(struct proc*, uint);
+static void *threadreap(struct proc*);
 
 
 struct {
@@ -87,9 +98,61 @@ myproc(void) {
   return p;
 }
 
+// The proc with the given pid, or 0.
+// Caller holds ptable.lock.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  for(p = ptable.hash[pid % NPIDHASH]; p; p = p->hnext)
+    if(p->pid == pid)
+      return p;
+  return 0;
+}
+
+// Take p out of the pid hash and put it on the free list.
+// Caller holds ptable.lock.
+static void
+freeproc(struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &ptable.hash[p->pid % NPIDHASH]; *pp; pp = &(*pp)->hnext)
+    if(*pp == p){
+      *pp = p->hnext;
+      break;
+    }
+  p->pid = 0;
+  p->state = UNUSED;
+  p->hnext = ptable.free;
+  ptable.free = p;
+}
+
+// Fill the free list with a page of new procs.
+// Caller holds ptable.lock.
+static int
+moreprocs(void)
+{
+  struct proc *p;
+  char *mem;
+
+  if(ptable.nproc + PGSIZE/sizeof(*p) > NPROC || (mem = kalloc(KM_PROC)) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  for(p = (struct proc*)mem; p + 1 <= (struct proc*)(mem + PGSIZE); p++){
+    p->next = ptable.list;
+    ptable.list = p;
+    p->hnext = ptable.free;
+    ptable.free = p;
+    ptable.nproc++;
+  }
+  return 0;
+}
+
 //PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
+// Take an UNUSED proc from the process table.
+// If there is one, change state to EMBRYO and initialize
 // state required to run in the kernel.
 // Otherwise return 0.
 static struct proc*
@@ -99,24 +162,38 @@ allocproc(void)
   char *sp;
 
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED){
-      goto found;
+  if(ptable.free == 0 && moreprocs() < 0){
+    release(&ptable.lock);
+    return 0;
   }
-  release(&ptable.lock);
-  return 0;
-
-found:
+  p = ptable.free;
+  ptable.free = p->hnext;
   p->state = EMBRYO;
-  if(nextpid > 10000){
-	nextpid = 3;
-  }
-  p->pid = nextpid++;
+  p->inkernel = 0;
+  p->kthread = 0;
+  p->logres = 0;
+  p->logged = 0;
+  p->vmalocked = 0;
+  p->vmafills = 0;
+  p->exited.done = 0;
+  p->exited.waiter = 0;
+  p->nchild = p->njoinable = 0;
+  // Pids wrap around; skip the ones still in use.
+  do {
+    if(nextpid > 10000){
+	  nextpid = 3;
+    }
+    p->pid = nextpid++;
+  } while(findproc(p->pid));
+  p->hnext = ptable.hash[p->pid % NPIDHASH];
+  ptable.hash[p->pid % NPIDHASH] = p;
   release(&ptable.lock);
 
   // Allocate kernel stack.
-  if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
+  if((p->kstack = kalloc(KM_KSTACK)) == 0){
+    acquire(&ptable.lock);
+    freeproc(p);
+    release(&ptable.lock);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE;
@@ -176,24 +253,65 @@ userinit(void)
   release(&ptable.lock);
 }
 
+// Start a kernel thread running fn(), which must never return.
+// It has no user memory, files or parent, and like init and the
+// first shell it is left out of MLFQ and stride scheduling.
+// Returns 0 on success, -1 on failure.
+int
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    return -1;
+  if((p->pgdir = setupkvm()) == 0){
+    kfree(p->kstack);
+    p->kstack = 0;
+    acquire(&ptable.lock);
+    freeproc(p);
+    release(&ptable.lock);
+    return -1;
+  }
+  // forkret() returns into fn() instead of trapret.
+  *(uint*)((char*)p->context + sizeof(*p->context)) = (uint)fn;
+  p->sz = 0;
+  p->parent = 0;
+  p->tid = 0;
+  p->tls = 0;
+  p->killed = 0;
+  p->kthread = 1;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&ptable.lock);
+  p->state = RUNNABLE;
+  release(&ptable.lock);
+  return 0;
+}
+
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
 {
   uint sz;
-  struct proc *curproc = myproc();
+  struct proc *curproc = vmaproc(myproc());
 
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if(sz + n > mmapbase(curproc))
+      return -1;
+    if(curproc->superpage)
+      sz = allocsuvm(curproc->pgdir, sz, sz + n);
+    else
+      sz = allocuvm(curproc->pgdir, sz, sz + n);
+    if(sz == 0)
       return -1;
   } else if(n < 0){
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
   }
   curproc->sz = sz;
-  switchuvm(curproc);
+  switchuvm(myproc());
   return 0;
 }
 
@@ -212,14 +330,27 @@ fork(void)
 	return -1;
   }
 
+  // A thread that forks leaves the child running on a copy of
+  // its stack, in the same slot.  The child holds that tid in its
+  // own thread table, so the stack can grow and no thread of the
+  // child is put on top of it.
+  acquire(&ptable.lock);
+  i = curproc->tid != 0 ? tidclaim(np, curproc->tid) : 0;
+  release(&ptable.lock);
+  if(i < 0)
+    goto bad;
+
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
-    kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
-    return -1;
+  if((np->pgdir = copyuvm(curproc->pgdir, vmaproc(curproc)->sz)) == 0)
+    goto bad;
+  if(mmapfork(curproc, np) < 0){
+    freevm(np->pgdir);
+    goto bad;
   }
-  np->sz = curproc->sz;
+  np->sz = vmaproc(curproc)->sz;
+  np->superpage = curproc->superpage;
+  np->tstack = vmaproc(curproc)->tstack;
+  np->tls = curproc->tls;
   np->parent = curproc;
   *np->tf = *curproc->tf;
 
@@ -227,9 +358,8 @@ fork(void)
   np->tf->eax = 0;
 
   for(i = 0; i < NOFILE; i++)
-    if(curproc->ofile[i])
-      np->ofile[i] = filedup(curproc->ofile[i]);
-  np->cwd = idup(curproc->cwd);
+    np->ofile[i] = fdfile(i);
+  np->cwd = cwdget();
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
@@ -238,12 +368,136 @@ fork(void)
   acquire(&ptable.lock);
 
   np->state = RUNNABLE;
+  curproc->nchild++;
+
+  release(&ptable.lock);
+
+  return pid;
+
+bad:
+  kfree(np->kstack);
+  np->kstack = 0;
+  acquire(&ptable.lock);
+  tidfreeall(np);
+  freeproc(np);
+  release(&ptable.lock);
+  return -1;
+}
+
+// Create a child running path with arguments argv, the way fork()
+// followed by exec() in the child would, but without copying the
+// caller's image first.  The child's fd i for i < 3 is the caller's
+// fd[i], or fd i if fd is 0 or fd[i] is -1; no other files are
+// passed on.  Returns the child's pid.
+int
+spawnproc(char *path, char **argv, int *fd)
+{
+  int i, pid;
+  uint sz, eip, sp;
+  pde_t *pgdir;
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  if((pgdir = execload(path, argv, &sz, &eip, &sp)) == 0)
+    return -1;
+  if((np = allocproc()) == 0){
+    freevm(pgdir);
+    return -1;
+  }
+  np->pgdir = pgdir;
+  np->sz = sz;
+  np->tstack = TSTACKSIZE;
+  np->tls = 0;
+  np->parent = curproc;
+  *np->tf = *curproc->tf;
+  np->tf->gs = 0;
+  np->tf->eax = 0;
+  np->tf->eip = eip;
+  np->tf->esp = sp;
+
+  for(i = 0; i < 3; i++)
+    np->ofile[i] = fdfile(fd && fd[i] >= 0 ? fd[i] : i);
+  np->cwd = cwdget();
+
+  execname(np, path);
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+
+  np->state = RUNNABLE;
+  curproc->nchild++;
 
   release(&ptable.lock);
 
   return pid;
 }
 
+// Wake p if it is sleeping on chan: an O(1) wakeup1() for when
+// there can be only one sleeper.  Caller holds ptable.lock.
+static void
+wakeproc(struct proc *p, void *chan)
+{
+  if(p->state == SLEEPING && p->chan == chan)
+    p->state = RUNNABLE;
+}
+
+// Put exited thread p on its parent's list of zombies.
+// Caller holds ptable.lock.
+static void
+zpush(struct proc *p)
+{
+  struct proc *parent = p->parent;
+
+  if((p->znext = parent->zombies) != 0)
+    p->znext->zpprev = &p->znext;
+  parent->zombies = p;
+  p->zpprev = &parent->zombies;
+}
+
+// Take p off its parent's list of zombies, if it is on it.
+// Caller holds ptable.lock.
+static void
+zunlink(struct proc *p)
+{
+  if(p->zpprev == 0)
+    return;
+  if((*p->zpprev = p->znext) != 0)
+    p->znext->zpprev = p->zpprev;
+  p->znext = 0;
+  p->zpprev = 0;
+}
+
+// Wake p if it is sleeping on chan.
+void
+wakeupproc(struct proc *p, void *chan)
+{
+  acquire(&ptable.lock);
+  wakeproc(p, chan);
+  release(&ptable.lock);
+}
+
+// Pass the children of exiting proc curproc to init.
+// Caller holds ptable.lock.
+static void
+reparent(struct proc *curproc)
+{
+  struct proc *p;
+
+  if(curproc->nchild == 0)
+    return;
+  for(p = ptable.list; p; p = p->next){
+    if(p->parent == curproc){
+      zunlink(p);
+      p->parent = initproc;
+      initproc->nchild++;
+      if(p->state == ZOMBIE)
+        wakeproc(initproc, initproc);
+    }
+  }
+  curproc->nchild = curproc->njoinable = 0;
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
@@ -251,38 +505,27 @@ void
 exit(void)
 {
   struct proc *curproc = myproc();
-  struct proc *p;
-  int fd;
 
   if(curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd]){
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
-    }
-  }
+  // Close all open files.  Threads have none of their own.
+  fdcloseall(curproc);
+  mmapexit(curproc);
 
-  begin_op();
-  iput(curproc->cwd);
-  end_op();
-  curproc->cwd = 0;
+  if(curproc->cwd){
+    begin_opn(iputblocks());
+    iput(curproc->cwd);
+    end_op();
+    curproc->cwd = 0;
+  }
 
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
   wakeup1(curproc->parent);
 
-  // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == curproc){
-      p->parent = initproc;
-      if(p->state == ZOMBIE)
-        wakeup1(initproc);
-    }
-  }
+  reparent(curproc);
 
   // Jump into the scheduler, never to return.
   curproc->state = ZOMBIE;
@@ -303,21 +546,38 @@ wait(void)
   for(;;){
     // Scan through table looking for exited children.
     havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    for(p = ptable.list; p; p = p->next){
       if(p->parent != curproc)
         continue;
       havekids = 1;
-      if(p->state == ZOMBIE){
+      // A thread someone is joining is theirs to reap.
+      if(p->state == ZOMBIE && (p->tid == 0 || p->exited.waiter == 0)){
         // Found one.
         pid = p->pid;
+        if(p->tid != 0 && vmaproc(p)->pgdir == p->pgdir){
+          // A thread of our address space: reap it as a join
+          // would, giving back its stack and tid.
+          zunlink(p);
+          threadreap(p);
+          return pid;
+        }
         kfree(p->kstack);
         p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
+        curproc->nchild--;
+        if(p->tid != 0){
+          // An orphaned thread: its pgdir and stack went with
+          // the process that created it.
+          zunlink(p);
+          curproc->njoinable--;
+          p->tid = 0;
+        } else {
+          freevm(p->pgdir);
+          tidfreeall(p);
+        }
         p->parent = 0;
         p->name[0] = 0;
         p->killed = 0;
-        p->state = UNUSED;
+        freeproc(p);
         release(&ptable.lock);
         return pid;
       }
@@ -553,12 +813,12 @@ scheduler(void)
     sti();
     // Loop over process table looking for process to run.
     acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    for(p = ptable.list; p; p = p->next){
      if(p->state != RUNNABLE) {
       continue;
      }
       /*acquire(&mlfq_lock);*/
-      if(mlfq[p->pid].is_mlfq == 0 && stride_table[p->pid].is_stride == 0 && p->pid > 2){
+      if(mlfq[p->pid].is_mlfq == 0 && stride_table[p->pid].is_stride == 0 && p->pid > 2 && !p->kthread){
        MLFQ_in(p,0,0); // case of new process, if so, new process go to MLFQ.
       }
       /*release(&mlfq_lock);*/
@@ -566,11 +826,11 @@ scheduler(void)
      result = path_cal();
 
 
-     if((result != 0) && (p -> pid) > 2){
+     if((result != 0) && (p -> pid) > 2 && !p->kthread){
       p = stride(result);
     }
      /*acquire(&mlfq_lock);*/
-     if((result == 0) && (p -> pid) > 2){
+     if((result == 0) && (p -> pid) > 2 && !p->kthread){
        q = stride(result);
        q = MLFQ();
        if(q != 0){
@@ -691,6 +951,7 @@ forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    swapinit(ROOTDEV);
   }
   // Return to "caller", actually trapret (see allocproc).
 }
@@ -741,7 +1002,7 @@ wakeup1(void *chan)
 {
   struct proc *p;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  for(p = ptable.list; p; p = p->next)
     if(p->state == SLEEPING && p->chan == chan)
       p->state = RUNNABLE;
 }
@@ -764,15 +1025,13 @@ kill(int pid)
   struct proc *p;
 
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
-      return 0;
-    }
+  if((p = findproc(pid)) != 0){
+    p->killed = 1;
+    // Wake process from sleep if necessary.
+    if(p->state == SLEEPING)
+      p->state = RUNNABLE;
+    release(&ptable.lock);
+    return 0;
   }
   release(&ptable.lock);
   return -1;
@@ -798,7 +1057,7 @@ procdump(void)
   char *state;
   uint pc[10];
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+  for(p = ptable.list; p; p = p->next){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -815,60 +1074,290 @@ procdump(void)
   }
 }
 
-uint mapper(struct proc * p, struct proc * np){
-//mapper function은 thread create 할때, stack의 위치를 정해줍니다.
-	uint i;
-	for(i = 1; i < 100; i++){
-		if(p->thread[i] == 0) {
-			p->thread[i] = 1;
-			p->thread_p[i] = np -> pid;
-			if(p->mtid <= i) {
-				p -> mtid = i;
-			}
-			break;
-		}
-	}
+// Clock hand of swapvictim(): the process and user address
+// where the last sweep stopped.
+static struct {
+  struct proc *p;
+  uint va;
+} swaphand;
+
+// Is q using its memory now: running, being set up, or inside
+// a system call (see trap())?
+static int
+busy(struct proc *q)
+{
+  return q->state != UNUSED && q->state != ZOMBIE &&
+         (q->state == RUNNING || q->state == EMBRYO || q->inkernel);
+}
+
+// Can p's memory be swapped out?  Only if neither p nor any of
+// its threads is busy, so no CPU is using the memory or its PTEs.
+// Caller holds ptable.lock.
+static int
+swappable(struct proc *p)
+{
+  struct proc *q;
+  uint tid;
+
+  if(p->state == UNUSED || p->state == EMBRYO || p->state == ZOMBIE)
+    return 0;
+  if(p->tid != 0 || p->pgdir == 0 || busy(p))
+    return 0;
+  for(tid = 1; tid <= p->ntid; tid++)
+    if((q = threadproc(p, tid)) != 0 && busy(q))
+      return 0;
+  return 1;
+}
+
+// Pick a user page to swap out with a clock sweep, replace its
+// PTE with swap entry swapent and return the page, or 0 if
+// there is none.  A page that was accessed since the last sweep
+// only loses its PTE_A.  Superpages and pages shared through
+// kref() or MAP_SHARED regions are never picked.
+char*
+swapvictim(uint swapent)
+{
+  struct proc *p;
+  pde_t *pde;
+  pte_t *pte;
+  uint va;
+  int i, pass;
+
+  acquire(&ptable.lock);
+  if(swaphand.p == 0)
+    swaphand.p = ptable.list;
+  for(i = 0; i <= ptable.nproc; i++){
+    p = swaphand.p;
+    if(swappable(p)){
+      // The second pass finds the pages whose PTE_A the first cleared.
+      for(pass = 0; pass < 2; pass++){
+        for(va = swaphand.va; va < KERNBASE; va += PGSIZE){
+          pde = &p->pgdir[PDX(va)];
+          if((*pde & PTE_P) == 0 || (*pde & PTE_PS)){
+            va = PGADDR(PDX(va) + 1, 0, 0) - PGSIZE;
+            continue;
+          }
+          pte = &((pte_t*)P2V(PTE_ADDR(*pde)))[PTX(va)];
+          if((*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U))
+            continue;
+          if(*pte & PTE_A){
+            *pte &= ~PTE_A;
+            continue;
+          }
+          if(pageref[PTE_ADDR(*pte)/PGSIZE] != 0 || mmapshared(p, va))
+            continue;
+          swaphand.va = va + PGSIZE;
+          va = PTE_ADDR(*pte);
+          *pte = swapent | (*pte & (PTE_W|PTE_U));
+          release(&ptable.lock);
+          return P2V(va);
+        }
+        swaphand.va = 0;
+      }
+    }
+    swaphand.va = 0;
+    if((swaphand.p = swaphand.p->next) == 0)
+      swaphand.p = ptable.list;
+  }
+  release(&ptable.lock);
+  return 0;
+}
+
+// Fill in up to n entries of pm, in user memory, with the memory
+// use of each process, counting threads with the process that
+// created them.  Returns the number of entries filled, or -1.
+int
+procmeminfo(struct procmem *pm, int n)
+{
+  struct proc *p;
+  struct procmem e;
+  int i;
+
+  i = 0;
+  acquire(&ptable.lock);
+  for(p = ptable.list; p && i < n; p = p->next){
+    if(p->state == UNUSED || p->tid != 0)
+      continue;
+    e.pid = p->pid;
+    e.state = p->state;
+    e.sz = p->sz;
+    e.nthread = p->nthread - (p->stid != 0);
+    if(p->state == ZOMBIE || p->pgdir == 0)
+      e.rss = e.swapped = 0;
+    else
+      uvmcount(p->pgdir, &e.rss, &e.swapped);
+    safestrcpy(e.name, p->name, sizeof(e.name));
+    if(umemmove(&pm[i], &e, sizeof(e)) < 0){
+      i = -1;
+      break;
+    }
+    i++;
+  }
+  release(&ptable.lock);
+  return i;
+}
+
+// Slot of thread tid in p's thread table.
+static struct proc**
+tidslot(struct proc *p, uint tid)
+{
+  return &p->tslot[tid / TPERCHUNK][tid % TPERCHUNK];
+}
+
+// Give np a tid in the thread table of p, the process whose
+// address space it shares, or return 0 if the table is full.
+// Free slots hold the next free tid, shifted left with the low
+// bit set, so taking and giving back a tid is O(1).
+// Caller holds ptable.lock.
+static uint
+tidalloc(struct proc *p, struct proc *np)
+{
+  struct proc **chunk;
+  uint tid;
+
+  if((tid = p->tidfree) != 0)
+    p->tidfree = (uint)*tidslot(p, tid) >> 1;
+  else {
+    tid = p->ntid + 1;
+    if(tid / TPERCHUNK >= NTCHUNK)
+      return 0;
+    if(p->tslot[tid / TPERCHUNK] == 0){
+      if((chunk = (struct proc**)kalloc(KM_PROC)) == 0)
+        return 0;
+      memset(chunk, 0, PGSIZE);
+      p->tslot[tid / TPERCHUNK] = chunk;
+    }
+    p->ntid = tid;
+  }
+  *tidslot(p, tid) = np;
+  p->nthread++;
+  return tid;
+}
+
+// Take tid in p's thread table, which must be empty, for p
+// itself: the child of a fork() from a thread runs on the copy of
+// the thread's stack, in that tid's slot (see fork()).  Smaller
+// tids stay free.  Returns -1 if out of memory.
+// Caller holds ptable.lock.
+static int
+tidclaim(struct proc *p, uint tid)
+{
+  struct proc **chunk;
+  uint t;
+
+  for(t = 0; t <= tid / TPERCHUNK; t++){
+    if(p->tslot[t] == 0){
+      if((chunk = (struct proc**)kalloc(KM_PROC)) == 0)
+        return -1;
+      memset(chunk, 0, PGSIZE);
+      p->tslot[t] = chunk;
+    }
+  }
+  for(t = tid - 1; t > 0; t--){
+    *tidslot(p, t) = (struct proc*)((p->tidfree << 1) | 1);
+    p->tidfree = t;
+  }
+  *tidslot(p, tid) = p;
+  p->ntid = tid;
+  p->nthread++;
+  p->stid = tid;
+  return 0;
+}
+
+// Give back the tid taken by tidclaim(), once exec() has dropped
+// the stack in its slot.
+void
+tidunclaim(struct proc *p)
+{
+  acquire(&ptable.lock);
+  if(p->stid != 0){
+    tidfree(p, p->stid);
+    p->stid = 0;
+  }
+  release(&ptable.lock);
+}
+
+// Give tid back to p's thread table.
+// Caller holds ptable.lock.
+static void
+tidfree(struct proc *p, uint tid)
+{
+  *tidslot(p, tid) = (struct proc*)((p->tidfree << 1) | 1);
+  p->tidfree = tid;
+  p->nthread--;
+}
+
+// Free p's thread table.
+static void
+tidfreeall(struct proc *p)
+{
+  int i;
+
+  for(i = 0; i < NTCHUNK; i++){
+    if(p->tslot[i])
+      kfree((char*)p->tslot[i]);
+    p->tslot[i] = 0;
+  }
+  p->tidfree = p->ntid = 0;
+  p->nthread = 0;
+  p->stid = 0;
+}
+
+// The thread with the given tid in p's thread table, or 0.
+struct proc*
+threadproc(struct proc *p, uint tid)
+{
+  struct proc *t;
 
-	return i;
+  if(tid == 0 || tid > p->ntid)
+    return 0;
+  t = *tidslot(p, tid);
+  return ((uint)t & 1) ? 0 : t;
 }
 
 int thread_create_os(thread_t* thread, void*(*start_routine)(void *),void * arg){
 	struct proc * p = myproc();
 	struct proc * np = allocproc();
+	struct proc * vp = vmaproc(p);
 
- 	uint sz,ustack[5];
-	uint sp;	
+ 	uint ustack[5];
+	uint sp;
 	if(np == 0){
 		return -1;
 	}
 
-	*thread = np->pid;
+	if(umemmove(thread, &np->pid, sizeof(*thread)) < 0)
+	 goto bad;
 
 	*np -> tf = *p -> tf;
 	np->sz = p->sz;
+	np->superpage = p->superpage;
 	np->parent = p;
-        for(int i = 0; i < NOFILE; i++)
-         if(p->ofile[i])
-          np->ofile[i] = filedup(p->ofile[i]);
-        np->cwd = idup(p->cwd);
+	// Files and the current directory are vp's, shared.
         safestrcpy(np->name, p->name, sizeof(p->name));
        //커널 스택 할당.
 
-	if(p->osz == 0) {	//osz는 프로세스가 쓰레드를 가지기 전의 p->sz를 기록한 것입니다.
-		p->osz = PGROUNDUP(p->sz);
-	}
+	// The stack slot is numbered among all threads sharing the
+	// address space, and only its top page is filled in now.
 	/*pushcli();*/
-	sz = PGROUNDUP((p->osz)+(2*((np->tid = mapper(p,np))-1)*PGSIZE));
-	if((sz = allocuvm(p->pgdir, sz, sz + 2*PGSIZE)) == 0){
-	 cprintf("allocuvm: error!\n");
-	 /*popcli();*/
-	 return -1;
+	acquire(&ptable.lock);
+	np->tid = tidalloc(vp, np);
+	release(&ptable.lock);
+	if(np->tid == 0)
+	 goto bad;
+	if((sp = stacktop(vp, np->tid)) == 0 || stackalloc(vp, np->tid) < 0){
+	 acquire(&ptable.lock);
+	 tidfree(vp, np->tid);
+	 release(&ptable.lock);
+	 goto bad;
 	}
-	clearpteu(p->pgdir, (char*)(sz - 2*PGSIZE));
-	sp = sz;
 
-	sp = (sp - 4) & ~3;
-	if(copyout(p->pgdir, sp, arg, 4) < 0) {
+	// The thread-local block sits at the top of the stack and
+	// starts with a pointer to itself (see set_tls()).
+	sp -= TLSSIZE;
+	np->tls = sp;
+	np->tf->gs = (SEG_UTLS << 3) | DPL_USER;
+	if(copyout(p->pgdir, sp, &sp, 4) < 0) {
 	 cprintf("copyout: error!\n");
 	/*popcli();*/
 	 return -1;
@@ -887,91 +1376,115 @@ int thread_create_os(thread_t* thread, void*(*start_routine)(void *),void * arg)
 
 	np -> pgdir = p -> pgdir;
 
-	np->sz = sz;
-	p -> sz = (p->osz)+(2*((p->mtid))*PGSIZE);
+	np->sz = vp->sz;
 	np-> tf -> eip = (uint)start_routine;
 	np -> tf -> esp = sp;
 
 	acquire(&ptable.lock);
 	np -> state = RUNNABLE;
+	p->nchild++;
+	p->njoinable++;
 	release(&ptable.lock);
 	/*popcli();*/
 	return 0;
+
+bad:
+	kfree(np->kstack);
+	np->kstack = 0;
+	np->tid = 0;
+	acquire(&ptable.lock);
+	freeproc(np);
+	release(&ptable.lock);
+	return -1;
+}
+
+// Free exited thread p and give back its tid.  Returns the
+// thread's return value.  Called with ptable.lock held, which it
+// releases.
+static void*
+threadreap(struct proc *p)
+{
+  struct proc *vp;
+  void *retval;
+  int tid;
+
+  kfree(p->kstack);
+  p->kstack = 0;
+  retval = p->retval;
+  if(p->pgdir == 0)
+    panic("freevm: no pgdir");
+  //차후 쓰레드 위치 재선정을 위해 값을 변경해줍니다.
+  vp = vmaproc(p);
+  tid = p->tid;
+  p->parent->nchild--;
+  p->parent->njoinable--;
+  p->tid = 0;
+  p->parent = 0;
+  p->name[0] = 0;
+  p->killed = 0;
+  freeproc(p);
+  release(&ptable.lock);
+  // Freeing the stack sleeps, so the tid stays taken until it is
+  // done.
+  stackfree(vp, tid);
+  acquire(&ptable.lock);
+  tidfree(vp, tid);
+  release(&ptable.lock);
+  return retval;
 }
 
 int thread_join_os(thread_t thread, void ** retval, int select, thread_t original_thread){
   //select 0(case of normal join), select 1(case of Emergency join,쓰레드나 프로세스가 쓰레드가 있는 상태에서 급하게 종료한 경우)
   struct proc *p;
-  int havekids;
   struct proc *curproc = myproc();
-  acquire(&ptable.lock);
-  for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-     if(select == 0) {
-      if((p->parent != curproc) || (p -> pid != thread))
-        continue;
-     }
-     if(select == 1) {
-	if((p->pid != thread)) {
-	  continue;
-	}
-     } 
-      if(select == 0) {
-        havekids = 1;
-      }
+  void *r;
 
-      if(p->state == ZOMBIE){
-        // Found one.
-        kfree(p->kstack);
-        p->kstack = 0;
-	*retval = (void*)p -> retval;
-        if(p->parent->sz == p->sz) {
-	  p->parent->sz = (p->sz)-2*PGSIZE;
-	}
-  	deallocuvm(p->pgdir, p->sz, (p->sz)-2*PGSIZE);
-       
-  	if(p->pgdir == 0)
-    	  panic("freevm: no pgdir");
-	//차후 쓰레드 위치 재선정을 위해 값을 변경해줍니다.  
-        p->pid = 0;
-	p->parent->thread[p->tid] = 0;
-	if(p->parent->mtid == p -> tid) {
-		for(int i = p->tid; i > 0; i=i-1){
-			if(p->parent->thread[i] == 1) {
-				p->parent->mtid = i;
-				break;
-			}
-			if(i == 1) {
-			  p->parent->mtid = 1;
-			}
-		}
-	}
-	p->parent->sz = (p->parent->osz)+(2*((p->mtid))*PGSIZE);
-	p->tid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
-        release(&ptable.lock);
-        return 0;
-      }
-    }
-
-    // No point waiting if we don't have any children.
-    if(select == 0) {
-    if(!havekids || curproc->killed){
+  acquire(&ptable.lock);
+  p = findproc(thread);
+  // Only one joiner, and normally only the thread's creator.
+  if(p == 0 || p->tid == 0 || p->exited.waiter != 0 ||
+     (select == 0 && p->parent != curproc)){
+    release(&ptable.lock);
+    return -1;
+  }
+  // Sleep on the thread's own completion, which only its exit
+  // wakes.
+  p->exited.waiter = curproc;
+  while(!p->exited.done){
+    if(select != 0 || curproc->killed){
+      p->exited.waiter = 0;
       release(&ptable.lock);
       return -1;
     }
-   }
+    sleep(&p->exited, &ptable.lock);  //DOC: wait-sleep
+  }
+  zunlink(p);
+  r = threadreap(p);
+  return umemmove(retval, &r, sizeof(r));
+}
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
-    if(select == 0) {
-    sleep(curproc, &ptable.lock);  //DOC: wait-sleep
+// Join whichever thread created by the caller exits first, or
+// has already exited, and store its id in *thread.
+int thread_join_any_os(thread_t* thread, void** retval){
+  struct proc *p;
+  struct proc *curproc = myproc();
+  thread_t pid;
+  void *r;
+
+  acquire(&ptable.lock);
+  while((p = curproc->zombies) == 0){
+    if(curproc->njoinable == 0 || curproc->killed){
+      release(&ptable.lock);
+      return -1;
     }
+    sleep(&curproc->zombies, &ptable.lock);
   }
+  zunlink(p);
+  pid = p->pid;
+  r = threadreap(p);
+  if(umemmove(thread, &pid, sizeof(pid)) < 0)
+    return -1;
+  return umemmove(retval, &r, sizeof(r));
 }
 
 void thread_exit_os(void *retval, thread_t thread){
@@ -981,13 +1494,10 @@ void thread_exit_os(void *retval, thread_t thread){
 
   if(thread != 0) {
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == thread){
-      curproc = p;
-      break;
-    }
-   }
-   release(&ptable.lock);
+  curproc = findproc(thread);
+  release(&ptable.lock);
+  if(curproc == 0)
+    return;
   }
 
   if(thread == 0) {
@@ -1008,35 +1518,25 @@ void thread_exit_os(void *retval, thread_t thread){
       release(&mlfq_lock);*/
 
      
-  int fd;
   if(curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd]){
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
-    }
-  }
-
-  begin_op();
-  iput(curproc->cwd);
-  end_op();
-  curproc->cwd = 0;
-
+  // The thread's files and current directory are shared with
+  // the rest of the process, so there is nothing to close.
   curproc->retval = retval;
 
   acquire(&ptable.lock);
-  wakeup1(curproc->parent);
-  // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == curproc){
-      p->parent = initproc;
-      if(p->state == ZOMBIE)
-        wakeup1(initproc);
-    }
+  curproc->exited.done = 1;
+  if((p = curproc->exited.waiter) != 0)
+    wakeproc(p, &curproc->exited);
+  else if(curproc->tid != 0){
+    // Nobody is joining it yet: leave it for thread_join_any(),
+    // or for wait() as before.
+    zpush(curproc);
+    wakeproc(curproc->parent, &curproc->parent->zombies);
+    wakeproc(curproc->parent, curproc->parent);
   }
+  reparent(curproc);
 
   // Jump into the scheduler, never to return.
   curproc->state = ZOMBIE;
@@ -8,6 +8,7 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  volatile uint tlbflush;      // Asked to flush its TLB, see tlbflush()
 };
 
 struct {
@@ -55,6 +56,17 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A region of the address space created by mmap().
+struct vma {
+  uint addr;                   // Start, page-aligned
+  uint len;                    // Length in bytes, page-aligned; 0 if unused
+  int prot;                    // PROT_READ, PROT_WRITE
+  int flags;                   // MAP_SHARED or MAP_PRIVATE, MAP_ANONYMOUS
+  struct file *f;              // Backing file, 0 if anonymous
+  struct shmseg *shm;          // Backing shared memory segment, or 0
+  uint off;                    // Offset in the file or segment
+};
+
 struct thread {
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
@@ -64,6 +76,18 @@ struct thread {
   struct context *context;     // swtch() here to run process
 };
 
+// What thread_join() waits on: set when a thread exits.
+struct completion {
+  int done;                    // The thread has exited
+  struct proc *waiter;         // Proc joining it, or 0
+};
+
+// A thread table is kept in pages of TPERCHUNK slots, allocated
+// as tids are first handed out: up to NTCHUNK*TPERCHUNK threads
+// per process, more than fit between TSTACKBASE and KERNBASE.
+#define TPERCHUNK  1024
+#define NTCHUNK    16
+
 // Per-process state
 struct proc {
   uint sz;                     // Size of process memory (bytes)
@@ -76,17 +100,36 @@ struct proc {
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
+  struct file *ofile[NOFILE];  // Open files (threads use their creator's)
+  struct inode *cwd;           // Current directory (likewise)
   char name[16];               // Process name (debugging)
   int share;		       // used in stride scheduling
-  int thread[100];             // thread per one process(total 100)
-  int thread_p[100];		// thread(including tid) list
+  struct proc **tslot[NTCHUNK]; // Threads by tid, see tidalloc()
+  uint tidfree;                // First free tid, or 0
+  uint ntid;                   // Highest tid handed out
+  int nthread;                 // Threads holding a tid
+  uint stid;                   // Tid of the stack slot p runs on, or 0
   uint tid;		       // tid of one theread that process made
-  uint osz;			// original size of process(except stack)
-  uint mtid;			// max tid of process(if stack is mapping on 1, 3, 9 then 9 is the max size)
   /*uint mapno;*/			// mapping number of thread 
   void* retval;		       // return value of thread
+  int superpage;               // If non-zero, grow heap with 4 MB superpages
+  uint tstack;                 // Bytes reserved for each thread's stack
+  uint tls;                    // Base of %gs (see set_tls()), or 0
+  struct vma vma[NMMAP];       // mmap() regions (threads use their creator's)
+  int vmalocked;               // vma table and faults held, see lockvma()
+  int vmafills;                // vmafill()s reading a page in, see vmaidle()
+  int inkernel;                // Syscalls and faults using user memory now
+  struct proc *next;           // Next in the process table
+  struct proc *hnext;          // Next in the pid hash chain or free list
+  struct completion exited;    // Exit of this thread
+  int nchild;                  // Children, threads included, not yet reaped
+  int njoinable;               // Threads it created, not yet joined
+  struct proc *zombies;        // Those that exited with no waiter
+  struct proc *znext;          // Next on the parent's zombies list
+  struct proc **zpprev;        // Link to this on that list, or 0
+  int kthread;                 // Runs only in the kernel, see kthread()
+  int logres;                  // Log blocks its FS op may still use
+  int logged;                  // Its FS op has changed a logged block
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -94,7 +137,10 @@ struct proc {
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
+//   mmap() regions, below TSTACKBASE
+//   thread stacks, from TSTACKBASE up to KERNBASE
 
 int thread_create_os(thread_t* thread, void*(*start_routine)(void*),void * arg);
 int thread_join_os(thread_t thread, void** retval, int select, thread_t original_thread);
 void thread_exit_os(void *retval, thread_t thread);
+int thread_join_any_os(thread_t* thread, void** retval);
@@ -23,11 +23,11 @@ int pwrite_w(void){
 		return -1;
 	}
 
-	if(argptr(1, (char**)&addr, sizeof(addr)) < 0) {
+	if(argint(2,&n) < 0) {
 		return -1;
 	}
 
-	if(argint(2,&n) < 0) {
+	if(argptr(1, (char**)&addr, n, 0) < 0) {
 		return -1;
 	}
 
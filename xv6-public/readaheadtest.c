@@ -0,0 +1,91 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+
+// Readahead: a file dropped from the cache with FADV_DONTNEED is
+// read back once with FADV_RANDOM, one synchronous disk read per
+// block, and once normally, where sequential reads start reading
+// ahead.  Then FADV_WILLNEED loads a range before it is read.
+
+#define NBLOCK 2048
+
+char buf[BSIZE];
+
+void
+fail(char *msg)
+{
+  printf(1, "readaheadtest: %s failed\n", msg);
+  unlink("readahead.tmp");
+  exit();
+}
+
+// Read blocks [0, n) with the given advice; returns the ticks.
+int
+readback(int advice, int n)
+{
+  int fd, i, start;
+
+  if((fd = open("readahead.tmp", O_RDONLY)) < 0)
+    fail("open");
+  if(fadvise(fd, 0, 0, advice) < 0)
+    fail("fadvise");
+  start = uptime();
+  for(i = 0; i < n; i++)
+    if(read(fd, buf, BSIZE) != BSIZE || buf[0] != (char)i || buf[BSIZE-1] != (char)i)
+      fail("read");
+  close(fd);
+  return uptime() - start;
+}
+
+// Drop the file from the cache.
+void
+dropfile(void)
+{
+  int fd;
+
+  if((fd = open("readahead.tmp", O_RDONLY)) < 0)
+    fail("open");
+  if(fadvise(fd, 0, 0, FADV_DONTNEED) < 0)
+    fail("FADV_DONTNEED");
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, ticks;
+
+  if((fd = open("readahead.tmp", O_CREATE|O_RDWR)) < 0)
+    fail("create");
+  for(i = 0; i < NBLOCK; i++){
+    memset(buf, i, BSIZE);
+    if(write(fd, buf, BSIZE) != BSIZE)
+      fail("write");
+  }
+  if(fadvise(fd, 0, 0, 99) != -1)
+    fail("bad advice");
+  close(fd);
+
+  dropfile();
+  ticks = readback(FADV_RANDOM, NBLOCK);
+  printf(1, "no readahead: %d KB in %d ticks\n", NBLOCK*BSIZE/1024, ticks);
+  dropfile();
+  ticks = readback(FADV_NORMAL, NBLOCK);
+  printf(1, "readahead:    %d KB in %d ticks\n", NBLOCK*BSIZE/1024, ticks);
+
+  dropfile();
+  if((fd = open("readahead.tmp", O_RDONLY)) < 0)
+    fail("open");
+  if(fadvise(fd, 0, 32*BSIZE, FADV_WILLNEED) < 0)
+    fail("FADV_WILLNEED");
+  close(fd);
+  sleep(10);
+  ticks = readback(FADV_RANDOM, 32);
+  printf(1, "willneed: 32 blocks in %d ticks\n", ticks);
+
+  unlink("readahead.tmp");
+  printf(1, "readaheadtest ok\n");
+  exit();
+}
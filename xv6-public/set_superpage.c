@@ -0,0 +1,28 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "date.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+
+// Opt in (on != 0) or out of backing heap growth with 4 MB
+// superpages.  Only sbrk() regions that cover a whole aligned
+// 4 MB run use them; growproc falls back to 4 KB pages whenever
+// no contiguous physical memory is free.  Returns the old setting.
+int set_superpage(int on){
+	int old;
+
+	old = myproc()->superpage;
+	myproc()->superpage = (on != 0);
+	return old;
+}
+
+int set_superpage_w(void){
+	int on;
+
+	if(argint(0,&on) < 0)
+	 return -1;
+	return set_superpage(on);
+}
@@ -0,0 +1,34 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "date.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+
+// Reserve size bytes, rounded up to pages, for the stack of each
+// thread created from now on.  Stack pages are only allocated as
+// the thread touches them.  The size fixes where every thread's
+// stack slot is, so it can only change while the process has no
+// threads.  Returns the old size, or -1.
+int set_thread_stack(int size){
+	struct proc *p = vmaproc(myproc());
+	int old;
+
+	if(size <= 0 || size > KERNBASE - TSTACKBASE - TGUARDSIZE)
+	 return -1;
+	if(p->nthread != 0)
+	 return -1;
+	old = p->tstack;
+	p->tstack = PGROUNDUP(size);
+	return old;
+}
+
+int set_thread_stack_w(void){
+	int size;
+
+	if(argint(0,&size) < 0)
+	 return -1;
+	return set_thread_stack(size);
+}
@@ -0,0 +1,32 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "date.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+
+// Make base the thread-local storage of the calling thread: %gs
+// then addresses memory from base, so the thread can find its
+// own data at %gs:0.  A thread starts with a TLSSIZE-byte block
+// at the top of its stack whose first word points at itself; a
+// process starts with none.  A base of 0 removes it.
+int set_tls(uint base){
+	struct proc *p = myproc();
+
+	if(base >= KERNBASE)
+	 return -1;
+	p->tls = base;
+	p->tf->gs = base ? (SEG_UTLS << 3) | DPL_USER : 0;
+	switchuvm(p);
+	return 0;
+}
+
+int set_tls_w(void){
+	int base;
+
+	if(argint(0,&base) < 0)
+	 return -1;
+	return set_tls((uint)base);
+}
@@ -52,6 +52,7 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
 
 // Execute cmd.  Never returns.
 void
@@ -130,6 +131,77 @@ runcmd(struct cmd *cmd)
   exit();
 }
 
+// Can cmd be started with spawn() from the shell itself?
+// Pipelines of simple commands with redirections can; lists,
+// background jobs and blocks need a forked shell to run them.
+int
+canspawn(struct cmd *cmd)
+{
+  switch(cmd->type){
+  case EXEC:
+    return 1;
+  case REDIR:
+    return canspawn(((struct redircmd*)cmd)->cmd);
+  case PIPE:
+    return canspawn(((struct pipecmd*)cmd)->left) &&
+           canspawn(((struct pipecmd*)cmd)->right);
+  }
+  return 0;
+}
+
+// Start cmd, which canspawn() accepted, with the shell's fds fd[]
+// as its fds 0, 1 and 2 (-1 for the shell's own).  Unlike runcmd(),
+// this runs in the shell, so errors return instead of exiting.
+// Returns the number of children started.
+int
+spawncmd(struct cmd *cmd, int *fd)
+{
+  int f, n, p[2], cfd[3];
+  struct execcmd *ecmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  memmove(cfd, fd, sizeof(cfd));
+  switch(cmd->type){
+  case EXEC:
+    ecmd = (struct execcmd*)cmd;
+    if(ecmd->argv[0] == 0)
+      return 0;
+    if(spawn(ecmd->argv[0], ecmd->argv, cfd) < 0){
+      printf(2, "exec %s failed\n", ecmd->argv[0]);
+      return 0;
+    }
+    return 1;
+
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    if((f = open(rcmd->file, rcmd->mode)) < 0){
+      printf(2, "open %s failed\n", rcmd->file);
+      return 0;
+    }
+    cfd[rcmd->fd] = f;
+    n = spawncmd(rcmd->cmd, cfd);
+    close(f);
+    return n;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    if(pipe(p) < 0){
+      printf(2, "pipe failed\n");
+      return 0;
+    }
+    cfd[1] = p[1];
+    n = spawncmd(pcmd->left, cfd);
+    memmove(cfd, fd, sizeof(cfd));
+    cfd[0] = p[0];
+    n += spawncmd(pcmd->right, cfd);
+    close(p[0]);
+    close(p[1]);
+    return n;
+  }
+  return 0;
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -145,7 +217,9 @@ int
 main(void)
 {
   static char buf[100];
-  int fd;
+  static int stdfd[3] = { -1, -1, -1 };
+  struct cmd *cmd;
+  int fd, n;
 
   // Ensure that three file descriptors are open.
   while((fd = open("console", O_RDWR)) >= 0){
@@ -164,9 +238,18 @@ main(void)
         printf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait();
+    if((cmd = parsecmd(buf)) == 0)
+      continue;
+    if(canspawn(cmd))
+      n = spawncmd(cmd, stdfd);
+    else {
+      if(fork1() == 0)
+        runcmd(cmd);
+      n = 1;
+    }
+    while(n-- > 0)
+      wait();
+    freecmd(cmd);
   }
   exit();
 }
@@ -262,6 +345,18 @@ backcmd(struct cmd *subcmd)
 char whitespace[] = " \t\r\n\v";
 char symbols[] = "<|>&;()";
 
+// The shell parses commands itself, so a syntax error must not
+// exit.  The parser notes the error and parsecmd() returns 0.
+int parseerr;
+
+void
+syntax(char *s)
+{
+  if(!parseerr)
+    printf(2, "%s\n", s);
+  parseerr = 1;
+}
+
 int
 gettoken(char **ps, char *es, char **q, char **eq)
 {
@@ -331,11 +426,16 @@ parsecmd(char *s)
   struct cmd *cmd;
 
   es = s + strlen(s);
+  parseerr = 0;
   cmd = parseline(&s, es);
   peek(&s, es, "");
-  if(s != es){
+  if(s != es && !parseerr){
     printf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntax("syntax");
+  }
+  if(parseerr){
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -379,8 +479,10 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
 
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
-    if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+    if(gettoken(ps, es, &q, &eq) != 'a'){
+      syntax("missing file for redirection");
+      break;
+    }
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -405,8 +507,10 @@ parseblock(char **ps, char *es)
     panic("parseblock");
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
-  if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
+  if(!peek(ps, es, ")")){
+    syntax("syntax - missing )");
+    return cmd;
+  }
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -428,16 +532,20 @@ parseexec(char **ps, char *es)
 
   argc = 0;
   ret = parseredirs(ret, ps, es);
-  while(!peek(ps, es, "|)&;")){
+  while(!peek(ps, es, "|)&;") && !parseerr){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
-    if(tok != 'a')
-      panic("syntax");
+    if(tok != 'a'){
+      syntax("syntax");
+      break;
+    }
+    if(argc >= MAXARGS-1){
+      syntax("too many args");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -491,3 +599,28 @@ nulterminate(struct cmd *cmd)
   }
   return cmd;
 }
+
+// Free the nodes of cmd.  The strings point into the input line.
+void
+freecmd(struct cmd *cmd)
+{
+  if(cmd == 0)
+    return;
+
+  switch(cmd->type){
+  case REDIR:
+    freecmd(((struct redircmd*)cmd)->cmd);
+    break;
+
+  case PIPE:
+  case LIST:
+    freecmd(((struct pipecmd*)cmd)->left);
+    freecmd(((struct pipecmd*)cmd)->right);
+    break;
+
+  case BACK:
+    freecmd(((struct backcmd*)cmd)->cmd);
+    break;
+  }
+  free(cmd);
+}
@@ -0,0 +1,105 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+// Commands per second: fork() then exec() against spawn(), first
+// from a small process and then from one with a 1 MB heap, which
+// fork() has to copy; then sh running a script of trivial commands.
+
+#define N 100
+
+char *echoargv[] = { "echo", "x", 0 };
+char *shargv[] = { "sh", 0 };
+
+void
+fail(char *msg)
+{
+  printf(1, "shbench: %s failed\n", msg);
+  exit();
+}
+
+int
+forkexec(int out)
+{
+  int pid;
+
+  if((pid = fork()) == 0){
+    close(1);
+    dup(out);
+    close(out);
+    exec(echoargv[0], echoargv);
+    exit();
+  }
+  return pid;
+}
+
+int
+spawnexec(int out)
+{
+  int fd[3] = { -1, out, -1 };
+
+  return spawn(echoargv[0], echoargv, fd);
+}
+
+void
+report(char *name, int start)
+{
+  int ticks;
+
+  if((ticks = uptime() - start) == 0)
+    ticks = 1;
+  printf(1, "%s\t%d commands in %d ticks\t%d commands/sec\n", name, N,
+         ticks, N * 100 / ticks);
+}
+
+void
+bench(char *name, int (*run)(int), int out)
+{
+  int i, start;
+
+  start = uptime();
+  for(i = 0; i < N; i++){
+    if(run(out) < 0)
+      fail(name);
+    wait();
+  }
+  report(name, start);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd[3], i, out, start;
+
+  if((out = open("shbench.out", O_CREATE|O_RDWR)) < 0)
+    fail("open");
+  bench("fork+exec", forkexec, out);
+  bench("spawn", spawnexec, out);
+
+  if(sbrk(1024*1024) == (char*)-1)
+    fail("sbrk");
+  printf(1, "with a 1 MB heap:\n");
+  bench("fork+exec", forkexec, out);
+  bench("spawn", spawnexec, out);
+
+  if((fd[0] = open("shbench.sh", O_CREATE|O_RDWR)) < 0)
+    fail("open");
+  for(i = 0; i < N; i++)
+    write(fd[0], "echo x\n", 7);
+  close(fd[0]);
+  if((fd[0] = open("shbench.sh", O_RDONLY)) < 0)
+    fail("open");
+  fd[1] = fd[2] = out;
+  start = uptime();
+  if(spawn(shargv[0], shargv, fd) < 0)
+    fail("spawn sh");
+  wait();
+  report("sh script", start);
+
+  close(fd[0]);
+  close(out);
+  unlink("shbench.sh");
+  unlink("shbench.out");
+  exit();
+}
@@ -0,0 +1,212 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "date.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "mman.h"
+#include "meminfo.h"
+
+// Shared memory segments.  A segment owns its pages through a page
+// directory of its own, indexed by offset in the segment, and pages
+// are allocated the first time some process touches them.  Each
+// process mapping of a page holds a kref() on it, so a page lives
+// until the segment and every page table that maps it let go.
+// shmat() maps a segment as an mmap region (see mmap.c); the
+// segment goes away once it has been removed and nobody has it
+// attached.  MAP_SHARED|MAP_ANONYMOUS regions use an unnamed segment.
+
+struct shmseg {
+  int key;                     // shmget() key, IPC_PRIVATE if unnamed
+  uint size;                   // Bytes, page-aligned; 0 if slot unused
+  int nattach;                 // Regions mapping the segment
+  int removed;                 // Free when nattach drops to 0
+  pde_t *pgdir;                // Pages of the segment
+};
+
+struct {
+  struct spinlock lock;
+  struct shmseg seg[NSHM];
+} shmtable;
+
+void
+shminit(void)
+{
+  initlock(&shmtable.lock, "shm");
+}
+
+// Allocate a segment with nattach 0.  Called with shmtable.lock held.
+static struct shmseg*
+shmalloc(int key, uint size)
+{
+  struct shmseg *s;
+
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++)
+    if(s->size == 0)
+      break;
+  if(s == &shmtable.seg[NSHM])
+    return 0;
+  if((s->pgdir = (pde_t*)kalloc(KM_PGTABLE)) == 0)
+    return 0;
+  memset(s->pgdir, 0, PGSIZE);
+  s->key = key;
+  s->size = size;
+  s->nattach = 0;
+  s->removed = 0;
+  return s;
+}
+
+// Free segment s if nothing needs it any more.
+// Called with shmtable.lock held.
+static void
+shmput(struct shmseg *s)
+{
+  if(s->nattach > 0 || !s->removed)
+    return;
+  // freevm() also drops each page's reference held by the segment.
+  freevm(s->pgdir);
+  s->pgdir = 0;
+  s->size = 0;
+}
+
+// New unnamed segment of size bytes, already attached once.
+struct shmseg*
+shmanon(uint size)
+{
+  struct shmseg *s;
+
+  acquire(&shmtable.lock);
+  if((s = shmalloc(IPC_PRIVATE, size)) != 0){
+    s->nattach = 1;
+    s->removed = 1;
+  }
+  release(&shmtable.lock);
+  return s;
+}
+
+// Count one more region mapping s.
+void
+shmdup(struct shmseg *s)
+{
+  acquire(&shmtable.lock);
+  s->nattach++;
+  release(&shmtable.lock);
+}
+
+// A region mapping s went away.
+void
+shmrelease(struct shmseg *s)
+{
+  acquire(&shmtable.lock);
+  s->nattach--;
+  shmput(s);
+  release(&shmtable.lock);
+}
+
+// Return the page at offset off of segment s, allocating it if
+// needed, with a reference taken for the caller's mapping.
+char*
+shmpage(struct shmseg *s, uint off)
+{
+  pte_t *pte;
+  char *mem;
+
+  acquire(&shmtable.lock);
+  if(off >= s->size || (pte = walkpgdir(s->pgdir, (char*)off, 1)) == 0){
+    release(&shmtable.lock);
+    return 0;
+  }
+  if((*pte & PTE_P) == 0){
+    if((mem = kalloc(KM_SHM)) == 0){
+      release(&shmtable.lock);
+      return 0;
+    }
+    memset(mem, 0, PGSIZE);
+    *pte = V2P(mem) | PTE_P | PTE_W | PTE_U;
+  }
+  mem = P2V(PTE_ADDR(*pte));
+  if(kref(mem) < 0)
+    mem = 0;
+  release(&shmtable.lock);
+  return mem;
+}
+
+// Look up the segment with id and its size, counting a new
+// attachment.
+struct shmseg*
+shmget_os(int id, uint *size)
+{
+  struct shmseg *s;
+
+  if(id < 0 || id >= NSHM)
+    return 0;
+  s = &shmtable.seg[id];
+  acquire(&shmtable.lock);
+  if(s->size == 0 || s->removed){
+    release(&shmtable.lock);
+    return 0;
+  }
+  s->nattach++;
+  *size = s->size;
+  release(&shmtable.lock);
+  return s;
+}
+
+// Mark segment id for removal; it is freed at its last detach.
+int
+shmrm_os(int id)
+{
+  struct shmseg *s;
+
+  if(id < 0 || id >= NSHM)
+    return -1;
+  s = &shmtable.seg[id];
+  acquire(&shmtable.lock);
+  if(s->size == 0 || s->removed){
+    release(&shmtable.lock);
+    return -1;
+  }
+  s->removed = 1;
+  shmput(s);
+  release(&shmtable.lock);
+  return 0;
+}
+
+// Return the id of the segment named key, creating a segment of
+// size bytes if there is none and flags has IPC_CREAT.
+// IPC_PRIVATE always creates a new segment that no key finds.
+int
+shmget(int key, int size, int flags)
+{
+  struct shmseg *s;
+
+  if(size <= 0 || size > TSTACKBASE - MMAPBASE)
+    return -1;
+  acquire(&shmtable.lock);
+  if(key != IPC_PRIVATE){
+    for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++){
+      if(s->size && !s->removed && s->key == key){
+        release(&shmtable.lock);
+        return s->size >= size ? s - shmtable.seg : -1;
+      }
+    }
+    if((flags & IPC_CREAT) == 0){
+      release(&shmtable.lock);
+      return -1;
+    }
+  }
+  s = shmalloc(key, PGROUNDUP((uint)size));
+  release(&shmtable.lock);
+  return s ? s - shmtable.seg : -1;
+}
+
+int shmget_w(void){
+	int key, size, flags;
+
+	if(argint(0,&key) < 0 || argint(1,&size) < 0 || argint(2,&flags) < 0)
+	 return -1;
+	return shmget(key, size, flags);
+}
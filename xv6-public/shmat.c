@@ -0,0 +1,21 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "date.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+
+int shmat(int id){
+
+	return shmat_os(id);
+}
+
+int shmat_w(void){
+	int id;
+
+	if(argint(0,&id) < 0)
+	 return -1;
+	return shmat(id);
+}
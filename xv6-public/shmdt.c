@@ -0,0 +1,21 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "date.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+
+int shmdt(uint addr){
+
+	return shmdt_os(addr);
+}
+
+int shmdt_w(void){
+	int addr;
+
+	if(argint(0,&addr) < 0)
+	 return -1;
+	return shmdt((uint)addr);
+}
@@ -0,0 +1,21 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "date.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+
+int shmrm(int id){
+
+	return shmrm_os(id);
+}
+
+int shmrm_w(void){
+	int id;
+
+	if(argint(0,&id) < 0)
+	 return -1;
+	return shmrm(id);
+}
@@ -0,0 +1,80 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "mman.h"
+
+#define KEY     1234
+#define SEGSIZE (256*1024)
+
+void
+fail(char *msg)
+{
+  printf(1, "shmtest: %s failed\n", msg);
+  exit();
+}
+
+// A forked producer fills a named segment that the parent reads.
+void
+segtest(void)
+{
+  int id, i, pid;
+  int *p;
+
+  printf(1, "1. named segment\n");
+  if((id = shmget(KEY, SEGSIZE, IPC_CREAT)) < 0)
+    fail("shmget");
+  pid = fork();
+  if(pid == 0){
+    if((p = shmat(shmget(KEY, SEGSIZE, 0))) == MAP_FAILED)
+      fail("child shmat");
+    for(i = 0; i < SEGSIZE/sizeof(int); i++)
+      p[i] = i;
+    shmdt(p);
+    exit();
+  }
+  wait();
+  if((p = shmat(id)) == MAP_FAILED)
+    fail("shmat");
+  for(i = 0; i < SEGSIZE/sizeof(int); i++)
+    if(p[i] != i)
+      fail("segment contents");
+  if(shmrm(id) < 0)
+    fail("shmrm");
+  if(shmget(KEY, SEGSIZE, 0) >= 0)
+    fail("removed segment still found");
+  // Still attached, so still usable.
+  p[0] = 42;
+  if(shmdt(p) < 0)
+    fail("shmdt");
+}
+
+// MAP_SHARED|MAP_ANONYMOUS memory is shared with children.
+void
+anontest(void)
+{
+  volatile int *p;
+  int pid;
+
+  printf(1, "2. shared anonymous mapping\n");
+  p = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if(p == MAP_FAILED)
+    fail("mmap");
+  pid = fork();
+  if(pid == 0){
+    p[0] = 7;
+    exit();
+  }
+  wait();
+  if(p[0] != 7)
+    fail("child write not seen");
+  munmap((void*)p, 4096);
+}
+
+int
+main(int argc, char *argv[])
+{
+  segtest();
+  anontest();
+  printf(1, "shm test ok\n");
+  exit();
+}
@@ -0,0 +1,42 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "date.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+
+// Run path with arguments argv in a new child process, like fork()
+// then exec() but without duplicating the caller.  fd, if not 0,
+// gives the caller's fds to use as the child's fds 0, 1 and 2.
+int spawn(char *path, char **argv, int *fd){
+
+	return spawnproc(path, argv, fd);
+}
+
+int spawn_w(void){
+	char path[MAXPATH], *argv[MAXARG];
+	int *fd, kfd[3];
+	int i;
+	uint uargv, uarg;
+
+	if(argpath(0,path) < 0 || argint(1,(int*)&uargv) < 0 || argint(2,(int*)&fd) < 0)
+	 return -1;
+	if(fd && (argptr(2,(char**)&fd,sizeof(kfd),0) < 0 || umemmove(kfd,fd,sizeof(kfd)) < 0))
+	 return -1;
+	memset(argv, 0, sizeof(argv));
+	for(i=0;; i++){
+	 if(i >= NELEM(argv))
+	  return -1;
+	 if(fetchint(uargv+4*i, (int*)&uarg) < 0)
+	  return -1;
+	 if(uarg == 0){
+	  argv[i] = 0;
+	  break;
+	 }
+	 if(fetchstr(uarg, &argv[i]) < 0)
+	  return -1;
+	}
+	return spawn(path, argv, fd ? kfd : 0);
+}
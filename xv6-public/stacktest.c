@@ -0,0 +1,156 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "meminfo.h"
+
+// Thread stacks grow on demand up to their reservation, end in a
+// guard gap, and are freed by thread_join().  A child forked by a
+// thread keeps growing its copy of the thread's stack.
+
+#define NTHREAD 4
+
+struct procmem pm[NPROC];
+
+void
+fail(char *msg)
+{
+  printf(1, "stacktest: %s failed\n", msg);
+  exit();
+}
+
+// Use about depth KB of stack.
+int
+recurse(int depth)
+{
+  volatile char buf[1000];
+  int i;
+
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = depth + i;
+  if(depth > 0)
+    return buf[depth % sizeof(buf)] + recurse(depth - 1);
+  return 0;
+}
+
+void*
+deep(void *arg)
+{
+  thread_exit((void*)recurse((int)arg));
+}
+
+// Resident pages of this process.
+uint
+rss(void)
+{
+  struct meminfo mi;
+  int i, n, pid;
+
+  pid = getpid();
+  n = meminfo(&mi, pm, NPROC);
+  for(i = 0; i < n; i++)
+    if(pm[i].pid == pid)
+      return pm[i].rss;
+  fail("meminfo");
+  return 0;
+}
+
+void
+growtest(int kb)
+{
+  thread_t t[NTHREAD];
+  void *ret, *first;
+  uint before;
+  int i;
+
+  before = rss();
+  first = 0;
+  for(i = 0; i < NTHREAD; i++)
+    if(thread_create(&t[i], deep, (void*)kb) != 0)
+      fail("thread_create");
+  for(i = 0; i < NTHREAD; i++){
+    if(thread_join(t[i], &ret) != 0)
+      fail("thread_join");
+    // The main thread's stack is too small to check against.
+    if(i == 0)
+      first = ret;
+    if(ret != first)
+      fail("deep stack contents");
+  }
+  if(rss() > before)
+    fail("freeing stacks at join");
+  printf(1, "%d threads used %d KB of stack each: ok\n", NTHREAD, kb);
+}
+
+void*
+overflow(void *arg)
+{
+  recurse(100000);
+  printf(1, "stacktest: ran past the end of the stack\n");
+  thread_exit(0);
+}
+
+void
+guardtest(void)
+{
+  thread_t t;
+  void *ret;
+
+  if(fork() == 0){
+    if(thread_create(&t, overflow, 0) != 0)
+      fail("thread_create");
+    thread_join(t, &ret);
+    exit();
+  }
+  wait();
+  printf(1, "guard: ok\n");
+}
+
+// In the child of a fork from a thread: grow the copied stack, and
+// run a thread of the child's own, which must get another slot.
+void*
+forker(void *arg)
+{
+  thread_t t;
+  void *ret;
+  int pid, want;
+
+  want = recurse(40);
+  if((pid = fork()) < 0)
+    fail("fork");
+  if(pid == 0){
+    if(recurse(40) != want)
+      fail("child stack");
+    if(thread_create(&t, deep, (void*)40) != 0 ||
+       thread_join(t, &ret) != 0 || ret != (void*)want)
+      fail("child thread");
+    if(recurse(40) != want)
+      fail("child stack after thread");
+    exit();
+  }
+  wait();
+  thread_exit(0);
+}
+
+void
+forktest(void)
+{
+  thread_t t;
+  void *ret;
+
+  if(thread_create(&t, forker, 0) != 0 || thread_join(t, &ret) != 0)
+    fail("thread");
+  printf(1, "fork from a thread: ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  growtest(48);
+  if(set_thread_stack(512*1024) < 0)
+    fail("set_thread_stack");
+  growtest(400);
+  guardtest();
+  forktest();
+  exit();
+}
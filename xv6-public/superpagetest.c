@@ -0,0 +1,62 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define MB (1024*1024)
+#define HEAPSIZE (16*MB)
+
+// Grow the heap by HEAPSIZE, touch every page, and check the
+// contents survive fork and a partial shrink.
+int
+grow(int super)
+{
+  char *p;
+  int i, start, pid;
+
+  set_superpage(super);
+  start = uptime();
+  p = sbrk(HEAPSIZE);
+  if(p == (char*)-1){
+    printf(1, "sbrk failed\n");
+    return -1;
+  }
+  for(i = 0; i < HEAPSIZE; i += 4096)
+    p[i] = i / 4096;
+  printf(1, "%s pages: sbrk+touch %d MB took %d ticks\n",
+         super ? "super" : "small", HEAPSIZE / MB, uptime() - start);
+
+  pid = fork();
+  if(pid == 0){
+    for(i = 0; i < HEAPSIZE; i += 4096)
+      if(p[i] != (char)(i / 4096)){
+        printf(1, "child: bad byte at %d\n", i);
+        exit();
+      }
+    exit();
+  }
+  wait();
+
+  // Cut into the middle of the last 4 MB run.
+  if(sbrk(-(2*MB + 4096)) == (char*)-1){
+    printf(1, "shrink failed\n");
+    return -1;
+  }
+  for(i = 0; i < HEAPSIZE - 2*MB - 4096; i += 4096)
+    if(p[i] != (char)(i / 4096)){
+      printf(1, "bad byte at %d after shrink\n", i);
+      return -1;
+    }
+  sbrk(-(HEAPSIZE - 2*MB - 4096));
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(grow(0) < 0 || grow(1) < 0){
+    printf(1, "superpage test failed\n");
+    exit();
+  }
+  printf(1, "superpage test ok\n");
+  exit();
+}
@@ -0,0 +1,219 @@
+// Swapping of user pages to the swap area that mkfs leaves after
+// the file system.
+//
+// When kalloc() runs dry, swapalloc() asks swapvictim() (proc.c)
+// for a page chosen by a clock sweep over the page tables of
+// processes whose memory nobody is using in the kernel right now.
+// The victim's PTE is replaced by a swap entry: PTE_SWAP set,
+// PTE_P clear, and the slot number in the address bits.  The page
+// is written to its slot and freed.  The next access faults and
+// swapin() reads the page back into a fresh frame.
+//
+// Each slot holds one page in PGSIZE/BSIZE consecutive blocks.
+// Swap I/O bypasses the buffer cache.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "meminfo.h"
+
+#define SLOTBLOCKS (PGSIZE/BSIZE)
+
+extern struct superblock sb;
+
+struct {
+  struct spinlock lock;        // protects used[]
+  struct sleeplock iolock;     // one swap-out or swap-in at a time
+  uint dev;
+  uint start;                  // first swap block
+  uint nslot;
+  uchar used[SWAPSIZE/SLOTBLOCKS];
+} swap;
+
+void
+swapinit(int dev)
+{
+  initlock(&swap.lock, "swap");
+  initsleeplock(&swap.iolock, "swapio");
+  swap.dev = dev;
+  swap.start = sb.swapstart;
+  swap.nslot = sb.nswap / SLOTBLOCKS;
+  if(swap.nslot > NELEM(swap.used))
+    swap.nslot = NELEM(swap.used);
+  cprintf("swap: %d pages at block %d\n", swap.nslot, swap.start);
+}
+
+static int
+slotalloc(void)
+{
+  int i;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    if(!swap.used[i]){
+      swap.used[i] = 1;
+      release(&swap.lock);
+      return i;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Fill in the swap part of *mi.
+void
+swapinfo(struct meminfo *mi)
+{
+  int i;
+
+  acquire(&swap.lock);
+  mi->swaptotal = swap.nslot;
+  mi->swapused = 0;
+  for(i = 0; i < swap.nslot; i++)
+    if(swap.used[i])
+      mi->swapused++;
+  release(&swap.lock);
+}
+
+// Release the slot of swap entry pte.
+void
+swapfree(uint pte)
+{
+  uint slot;
+
+  slot = PTE_ADDR(pte) >> PTXSHIFT;
+  if(!(pte & PTE_SWAP) || slot >= swap.nslot)
+    panic("swapfree");
+  acquire(&swap.lock);
+  swap.used[slot] = 0;
+  release(&swap.lock);
+}
+
+// Read or write the page mem from or to slot.
+static void
+slotrw(uint slot, char *mem, int write)
+{
+  struct buf b;
+  uchar data[BSIZE];
+  int i;
+
+  memset(&b, 0, sizeof(b));
+  b.data = data;
+  initsleeplock(&b.lock, "swapbuf");
+  acquiresleep(&b.lock);
+  b.dev = swap.dev;
+  for(i = 0; i < SLOTBLOCKS; i++){
+    b.blockno = swap.start + slot*SLOTBLOCKS + i;
+    if(write){
+      memmove(b.data, mem + i*BSIZE, BSIZE);
+      b.flags = B_DIRTY;
+    } else
+      b.flags = 0;
+    iderw(&b);
+    if(!write)
+      memmove(mem + i*BSIZE, b.data, BSIZE);
+  }
+  releasesleep(&b.lock);
+}
+
+// Push one page out to swap.  Caller holds swap.iolock.
+// Returns 0 if a page was freed.
+static int
+evict(void)
+{
+  char *mem;
+  int slot;
+
+  if((slot = slotalloc()) < 0)
+    return -1;
+  if((mem = swapvictim((slot << PTXSHIFT) | PTE_SWAP)) == 0){
+    swapfree((slot << PTXSHIFT) | PTE_SWAP);
+    return -1;
+  }
+  slotrw(slot, mem, 1);
+  kfree(mem);
+  return 0;
+}
+
+// kalloc() for user pages: if memory is short, shrink the buffer
+// cache, then swap other processes' pages out to make room.  Must be called from a
+// process that holds no spinlocks.
+char*
+swapalloc(void)
+{
+  char *mem;
+
+  // Cached blocks go before user pages.
+  while((mem = kalloc(KM_USER)) == 0 && bshrink() == 0)
+    ;
+  if(mem != 0 || swap.nslot == 0)
+    return mem;
+  acquiresleep(&swap.iolock);
+  while((mem = kalloc(KM_USER)) == 0 && evict() == 0)
+    ;
+  releasesleep(&swap.iolock);
+  return mem;
+}
+
+// Bring the page at va back if it is swapped out.
+// Returns 0 if the page is present afterwards.
+int
+swapin(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  char *mem;
+
+  acquiresleep(&swap.iolock);
+  if((pte = walkpgdir(pgdir, (char*)va, 0)) == 0 || (*pte & (PTE_P|PTE_SWAP)) == 0){
+    releasesleep(&swap.iolock);
+    return -1;
+  }
+  if(*pte & PTE_P){
+    // Another thread got here first.
+    releasesleep(&swap.iolock);
+    return 0;
+  }
+  while((mem = kalloc(KM_USER)) == 0)
+    if(bshrink() < 0 && evict() < 0){
+      releasesleep(&swap.iolock);
+      return -1;
+    }
+  slotrw(PTE_ADDR(*pte) >> PTXSHIFT, mem, 0);
+  swapfree(*pte);
+  *pte = V2P(mem) | (PTE_FLAGS(*pte) & ~PTE_SWAP) | PTE_P;
+  releasesleep(&swap.iolock);
+  return 0;
+}
+
+// Copy the page held by swap entry pte into mem.
+void
+swapread(uint pte, char *mem)
+{
+  acquiresleep(&swap.iolock);
+  slotrw(PTE_ADDR(pte) >> PTXSHIFT, mem, 0);
+  releasesleep(&swap.iolock);
+}
+
+// Swap in whatever part of [addr, addr+len) in the current
+// process's image is swapped out, so that a system call can use
+// it.  The process is inside the kernel until the call returns,
+// so its pages are not picked again meanwhile.
+void
+swapuser(uint addr, uint len)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = PGROUNDDOWN(addr); a < addr + len; a += PGSIZE){
+    pte = walkpgdir(myproc()->pgdir, (char*)a, 0);
+    if(pte && (*pte & PTE_SWAP))
+      swapin(myproc()->pgdir, a);
+  }
+}
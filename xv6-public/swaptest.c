@@ -0,0 +1,47 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define MB (1024*1024)
+
+// Two processes each grow to the given size (default 64 MB) one
+// megabyte at a time, then check every page.  Run with less memory
+// than that (e.g. make qemu with -m 64) to make the kernel swap.
+void
+grow(int mb, int seed)
+{
+  char *p;
+  int i, n;
+
+  p = sbrk(0);
+  for(n = 0; n < mb; n++){
+    if(sbrk(MB) == (char*)-1){
+      printf(1, "swaptest: sbrk failed after %d MB\n", n);
+      exit();
+    }
+    for(i = n*MB; i < (n+1)*MB; i += 4096)
+      p[i] = (i/4096 + seed) % 127;
+  }
+  for(i = 0; i < mb*MB; i += 4096){
+    if(p[i] != (i/4096 + seed) % 127){
+      printf(1, "swaptest: bad page at %d\n", i);
+      exit();
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mb, start, pid;
+
+  mb = argc > 1 ? atoi(argv[1]) : 64;
+  start = uptime();
+  pid = fork();
+  grow(mb, pid == 0);
+  if(pid == 0)
+    exit();
+  wait();
+  printf(1, "swaptest ok: 2 x %d MB in %d ticks\n", mb, uptime() - start);
+  exit();
+}
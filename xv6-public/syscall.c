@@ -17,12 +17,14 @@
 int
 fetchint(uint addr, int *ip)
 {
-  struct proc *curproc = myproc();
+  struct proc *curproc = vmaproc(myproc());
 
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
-    return -1;
-  *ip = *(int*)(addr);
-  return 0;
+  if(addr >= curproc->sz || addr+4 > curproc->sz){
+    if(mmapuser(addr, 4, 0) < 0)
+      return -1;
+  } else
+    swapuser(addr, 4);
+  return umemmove(ip, (char*)addr, 4);
 }
 
 // Fetch the nul-terminated string at addr from the current process.
@@ -31,15 +33,19 @@ fetchint(uint addr, int *ip)
 int
 fetchstr(uint addr, char **pp)
 {
-  char *s, *ep;
-  struct proc *curproc = myproc();
+  char *s, *ep, c;
+  struct proc *curproc = vmaproc(myproc());
 
   if(addr >= curproc->sz)
-    return -1;
+    return mmapstr(addr, pp);
   *pp = (char*)addr;
   ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
-    if(*s == 0)
+    if(s == *pp || (uint)s % PGSIZE == 0)
+      swapuser((uint)s, 1);
+    if(umemmove(&c, s, 1) < 0)
+      return -1;
+    if(c == 0)
       return s - *pp;
   }
   return -1;
@@ -54,25 +60,33 @@ argint(int n, int *ip)
 
 // Fetch the nth word-sized system call argument as a pointer
 // to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
+// lies within the process address space: below sz, or in
+// mmap regions, writable ones if the kernel is to write the
+// block.  Pages that are swapped out or not yet faulted in are
+// brought in first.
 int
-argptr(int n, char **pp, int size)
+argptr(int n, char **pp, int size, int write)
 {
   int i;
-  struct proc *curproc = myproc();
- 
+  struct proc *curproc = vmaproc(myproc());
+
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0)
     return -1;
+  if((uint)i >= curproc->sz || (uint)i+size > curproc->sz){
+    if(mmapuser((uint)i, size, write) < 0)
+      return -1;
+  } else
+    swapuser((uint)i, size);
   *pp = (char*)i;
   return 0;
 }
 
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// Other threads may still change or unmap the string afterwards, so
+// the kernel should read it only with umemmove(), or use argpath().
 int
 argstr(int n, char **pp)
 {
@@ -82,6 +96,23 @@ argstr(int n, char **pp)
   return fetchstr(addr, pp);
 }
 
+// Fetch the nth word-sized system call argument as a path, and
+// copy it into buf, which holds MAXPATH bytes, for the file
+// system to work on.
+int
+argpath(int n, char *buf)
+{
+  char *s;
+  int len;
+
+  if((len = argstr(n, &s)) < 0 || len >= MAXPATH)
+    return -1;
+  if(umemmove(buf, s, len) < 0)
+    return -1;
+  buf[len] = 0;
+  return len;
+}
+
 extern int sys_chdir(void);
 extern int sys_close(void);
 extern int sys_dup(void);
@@ -112,6 +143,21 @@ extern int thread_exit_w(void);
 extern int thread_join_w(void);
 extern int pwrite_w(void);
 extern int pread_w(void);
+extern int set_superpage_w(void);
+extern int mmap_w(void);
+extern int munmap_w(void);
+extern int shmget_w(void);
+extern int shmat_w(void);
+extern int shmdt_w(void);
+extern int shmrm_w(void);
+extern int meminfo_w(void);
+extern int spawn_w(void);
+extern int set_thread_stack_w(void);
+extern int thread_join_any_w(void);
+extern int futex_wait_w(void);
+extern int futex_wake_w(void);
+extern int set_tls_w(void);
+extern int fadvise_w(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -145,6 +191,21 @@ static int (*syscalls[])(void) = {
 [SYS_thread_join] thread_join_w,
 [SYS_pwrite]	pwrite_w,
 [SYS_pread]	pread_w,
+[SYS_set_superpage]	set_superpage_w,
+[SYS_mmap]	mmap_w,
+[SYS_munmap]	munmap_w,
+[SYS_shmget]	shmget_w,
+[SYS_shmat]	shmat_w,
+[SYS_shmdt]	shmdt_w,
+[SYS_shmrm]	shmrm_w,
+[SYS_meminfo]	meminfo_w,
+[SYS_spawn]	spawn_w,
+[SYS_set_thread_stack]	set_thread_stack_w,
+[SYS_thread_join_any]	thread_join_any_w,
+[SYS_futex_wait]	futex_wait_w,
+[SYS_futex_wake]	futex_wake_w,
+[SYS_set_tls]	set_tls_w,
+[SYS_fadvise]	fadvise_w,
 };
 
 void
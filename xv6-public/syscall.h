@@ -30,3 +30,18 @@
 #define SYS_thread_join 29
 #define SYS_pwrite 30
 #define SYS_pread 31
+#define SYS_set_superpage 32
+#define SYS_mmap 33
+#define SYS_munmap 34
+#define SYS_shmget 35
+#define SYS_shmat 36
+#define SYS_shmdt 37
+#define SYS_shmrm 38
+#define SYS_meminfo 39
+#define SYS_spawn 40
+#define SYS_set_thread_stack 41
+#define SYS_thread_join_any 42
+#define SYS_futex_wait 43
+#define SYS_futex_wake 44
+#define SYS_set_tls 45
+#define SYS_fadvise 46
@@ -20,10 +20,17 @@ sys_exit(void)
   return 0;  // not reached
 }
 
+// wait() and sleep() do not touch user memory while they block,
+// so the memory of a process waiting in them may be swapped out.
 int
 sys_wait(void)
 {
-  return wait();
+  int pid;
+
+  myproc()->inkernel--;
+  pid = wait();
+  myproc()->inkernel++;
+  return pid;
 }
 
 int
@@ -50,7 +57,7 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
+  addr = vmaproc(myproc())->sz;
   if(growproc(n) < 0)
     return -1;
   return addr;
@@ -64,16 +71,19 @@ sys_sleep(void)
 
   if(argint(0, &n) < 0)
     return -1;
+  myproc()->inkernel--;
   acquire(&tickslock);
   ticks0 = ticks;
   while(ticks - ticks0 < n){
     if(myproc()->killed){
       release(&tickslock);
+      myproc()->inkernel++;
       return -1;
     }
     sleep(&ticks, &tickslock);
   }
   release(&tickslock);
+  myproc()->inkernel++;
   return 0;
 }
 
@@ -20,11 +20,11 @@ int thread_create_w(void){
 	int* input;
 	void* input2;
 	void* input3;
-	if(argptr(0,(char**)&input,sizeof(input)) < 0)
+	if(argptr(0,(char**)&input,sizeof(input),1) < 0)
 	 return -1;
-	if(argptr(1,(char**)&input2,sizeof(input2)) < 0)
+	if(argptr(1,(char**)&input2,sizeof(input2),0) < 0)
 	 return -1;
-	if(argptr(2,(char**)&input3,sizeof(input3)) < 0)
+	if(argptr(2,(char**)&input3,sizeof(input3),0) < 0)
 	 return -1;
 	return thread_create(input, (void*)input2, (void*)input3);
 
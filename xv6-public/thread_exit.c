@@ -18,7 +18,7 @@ void thread_exit(void *retval){
 int thread_exit_w(void) {
 
 	void * input;
-	if(argptr(0, (char**)&input, sizeof(input)) < 0)
+	if(argptr(0, (char**)&input, sizeof(input), 0) < 0)
 	  return -1;
 	thread_exit((void*)input);
 	return -1;
@@ -18,9 +18,9 @@ int thread_join_w(void) {
 	int * input;
 	void* input2;
 
-	if(argptr(0,(char**)&input,sizeof(input)) < 0)
+	if(argptr(0,(char**)&input,sizeof(input),0) < 0)
 	  return -1;
-	if(argptr(1,(char**)&input2,sizeof(input2)) < 0)
+	if(argptr(1,(char**)&input2,sizeof(input2),1) < 0)
 	  return -1;
 	return thread_join((thread_t)input, (void **)input2);
 }
@@ -0,0 +1,25 @@
+#include "types.h"
+#include "x86.h"
+#include "defs.h"
+#include "date.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+
+// Join whichever thread the caller created exits first, and
+// store its id in *thread.  Returns -1 if there is none left.
+int thread_join_any(thread_t *thread, void **retval){
+	return thread_join_any_os(thread, retval);
+}
+
+int thread_join_any_w(void){
+	thread_t *thread;
+	void **retval;
+
+	if(argptr(0,(char**)&thread,sizeof(*thread),1) < 0)
+	 return -1;
+	if(argptr(1,(char**)&retval,sizeof(*retval),1) < 0)
+	 return -1;
+	return thread_join_any(thread, retval);
+}
@@ -0,0 +1,169 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "uthread.h"
+
+// The uthread.c locks under load.  Throughput: 1 to NTHREAD
+// threads each take a lock NITER times around a short critical
+// section.  Handoff: two threads pass a token back and forth
+// through a mutex and condition variable, so each pass is a
+// wakeup of a sleeping thread.  Barrier: rounds per second.
+
+#define NTHREAD 10
+#define NITER   20000
+#define NPASS   2000
+#define NROUND  500
+
+struct spinlock spin;
+struct mutex mutex;
+struct rwlock rwlock;
+struct cond cond;
+struct barrier barrier;
+volatile int counter;
+int turn;
+
+void
+fail(char *msg)
+{
+  printf(1, "threadbench: %s failed\n", msg);
+  exit();
+}
+
+void
+critical(void)
+{
+  int i;
+
+  for(i = 0; i < 10; i++)
+    counter++;
+}
+
+void*
+spinworker(void *arg)
+{
+  int i;
+
+  for(i = 0; i < NITER; i++){
+    spin_lock(&spin);
+    critical();
+    spin_unlock(&spin);
+  }
+  thread_exit(0);
+}
+
+void*
+mutexworker(void *arg)
+{
+  int i;
+
+  for(i = 0; i < NITER; i++){
+    mutex_lock(&mutex);
+    critical();
+    mutex_unlock(&mutex);
+  }
+  thread_exit(0);
+}
+
+// One write for every 16 reads.
+void*
+rwworker(void *arg)
+{
+  int i;
+
+  for(i = 0; i < NITER; i++){
+    if(i % 16 == 0){
+      rwlock_wrlock(&rwlock);
+      critical();
+    } else {
+      rwlock_rdlock(&rwlock);
+      if(counter < 0)
+        fail("rwlock");
+    }
+    rwlock_unlock(&rwlock);
+  }
+  thread_exit(0);
+}
+
+void*
+passer(void *arg)
+{
+  int me, i;
+
+  me = (int)arg;
+  for(i = 0; i < NPASS; i++){
+    mutex_lock(&mutex);
+    while(turn != me)
+      cond_wait(&cond, &mutex);
+    turn = !me;
+    cond_signal(&cond);
+    mutex_unlock(&mutex);
+  }
+  thread_exit(0);
+}
+
+void*
+barrierworker(void *arg)
+{
+  int i;
+
+  for(i = 0; i < NROUND; i++)
+    barrier_wait(&barrier);
+  thread_exit(0);
+}
+
+int
+run(void *(*fn)(void*), int nthread)
+{
+  thread_t t[NTHREAD];
+  void *ret;
+  int i, start, ticks;
+
+  start = uptime();
+  for(i = 0; i < nthread; i++)
+    if(thread_create(&t[i], fn, (void*)i) != 0)
+      fail("thread_create");
+  for(i = 0; i < nthread; i++)
+    if(thread_join(t[i], &ret) != 0)
+      fail("thread_join");
+  if((ticks = uptime() - start) == 0)
+    ticks = 1;
+  return ticks;
+}
+
+void
+throughput(char *name, void *(*fn)(void*))
+{
+  static int nthreads[] = { 1, 2, 4, 10 };
+  int i, n, ticks;
+
+  for(i = 0; i < sizeof(nthreads)/sizeof(nthreads[0]); i++){
+    n = nthreads[i];
+    counter = 0;
+    ticks = run(fn, n);
+    if(fn != rwworker && counter != n * NITER * 10)
+      fail(name);
+    printf(1, "%s\t%d threads\t%d ticks\t%d ops/sec\n", name, n, ticks,
+           n * NITER * 100 / ticks);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ticks;
+
+  throughput("spin", spinworker);
+  throughput("mutex", mutexworker);
+  throughput("rwlock", rwworker);
+
+  turn = 0;
+  ticks = run(passer, 2);
+  printf(1, "handoff\t%d passes\t%d ticks\t%d us/pass\n", 2 * NPASS, ticks,
+         ticks * 10000 / (2 * NPASS));
+
+  barrier_init(&barrier, NTHREAD);
+  ticks = run(barrierworker, NTHREAD);
+  printf(1, "barrier\t%d threads\t%d ticks\t%d rounds/sec\n", NTHREAD, ticks,
+         NROUND * 100 / ticks);
+  exit();
+}
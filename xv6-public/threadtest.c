@@ -1,9 +1,10 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "fcntl.h"
 
 #define NUM_THREAD 10
-#define NTEST 14
+#define NTEST 15
 
 // Show race condition
 int racingtest(void);
@@ -42,6 +43,9 @@ int sleeptest(void);
 int stridetest1(void);
 int stridetest2(void);
 
+// Test that threads share open files and the current directory
+int fdtest(void);
+
 int gcnt;
 int gpipe[2];
 
@@ -60,6 +64,7 @@ int (*testfunc[NTEST])(void) = {
   sleeptest,
   stridetest1,
   stridetest2,
+  fdtest,
 };
 char *testname[NTEST] = {
   "racingtest",
@@ -76,6 +81,7 @@ char *testname[NTEST] = {
   "sleeptest",
   "stridetest1",
   "stridetest2",
+  "fdtest",
 };
 
 int
@@ -690,3 +696,55 @@ stridetest2(void)
 }
 
 // ============================================================================
+void*
+fdthreadmain(void *arg)
+{
+  int fd;
+
+  if ((fd = open("fdtest", O_CREATE|O_RDWR)) < 0)
+    thread_exit((void*)-1);
+  write(fd, "shared", 6);
+  if (chdir("fdtestdir") < 0)
+    thread_exit((void*)-1);
+  thread_exit((void*)fd);
+}
+
+int
+fdtest(void)
+{
+  thread_t thread;
+  void *retval;
+  struct stat st;
+  int fd;
+
+  if (mkdir("fdtestdir") < 0){
+    printf(1, "panic at mkdir\n");
+    return -1;
+  }
+  if (thread_create(&thread, fdthreadmain, 0) != 0){
+    printf(1, "panic at thread_create\n");
+    return -1;
+  }
+  if (thread_join(thread, &retval) != 0 || (int)retval < 0){
+    printf(1, "panic at thread_join\n");
+    return -1;
+  }
+  // The thread has exited, but its file is still open here.
+  fd = (int)retval;
+  if (fstat(fd, &st) < 0 || st.size != 6){
+    printf(1, "panic at validation of the shared file\n");
+    return -1;
+  }
+  close(fd);
+  // The thread's chdir() moved this thread too.
+  if ((fd = open("../fdtest", O_RDONLY)) < 0 || unlink("../fdtest") < 0){
+    printf(1, "panic at validation of the shared directory\n");
+    return -1;
+  }
+  close(fd);
+  chdir("..");
+  unlink("fdtestdir");
+  return 0;
+}
+
+// ============================================================================
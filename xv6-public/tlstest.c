@@ -0,0 +1,70 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "uthread.h"
+
+// Every thread has its own thread-local block at %gs:0, which
+// survives the thread being switched out, and the first thread
+// gets one with set_tls().
+
+#define NTHREAD 8
+
+struct tls maintls;
+struct tls *blocks[NTHREAD];
+
+void
+fail(char *msg)
+{
+  printf(1, "tlstest: %s failed\n", msg);
+  exit();
+}
+
+void*
+worker(void *arg)
+{
+  struct tls *t;
+  int i, me;
+
+  me = (int)arg;
+  if((t = tls()) == 0 || t->self != t)
+    thread_exit((void*)1);
+  blocks[me] = t;
+  for(i = 0; i < 1000; i++){
+    t->data[0] = (void*)(me * 1000 + i);
+    yield();
+    if(tls() != t || t->data[0] != (void*)(me * 1000 + i))
+      thread_exit((void*)1);
+  }
+  thread_exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  thread_t t[NTHREAD];
+  void *ret;
+  int i, j;
+
+  for(i = 0; i < NTHREAD; i++)
+    if(thread_create(&t[i], worker, (void*)i) != 0)
+      fail("thread_create");
+  for(i = 0; i < NTHREAD; i++)
+    if(thread_join(t[i], &ret) != 0 || ret != 0)
+      fail("thread block");
+  for(i = 0; i < NTHREAD; i++)
+    for(j = 0; j < i; j++)
+      if(blocks[i] == blocks[j])
+        fail("distinct blocks");
+  printf(1, "threads: ok\n");
+
+  // malloc() may have given this thread a block already.
+  if(tls() != 0 && tls()->self != tls())
+    fail("main thread block");
+  maintls.self = &maintls;
+  if(set_tls(&maintls) < 0 || tls() != &maintls)
+    fail("set_tls");
+  if(set_tls(0) < 0 || tls() != 0)
+    fail("set_tls(0)");
+  printf(1, "set_tls: ok\n");
+  exit();
+}
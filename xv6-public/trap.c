@@ -32,15 +32,45 @@ idtinit(void)
   lidt(idt, sizeof(idt));
 }
 
+// Kernel instructions that may fault on user memory that has gone
+// away, and where to resume if they do.
+extern char umemcopy[], umemfail[];
+static struct {
+  char *eip;
+  char *fixup;
+} fixups[] = {
+  { umemcopy, umemfail },
+};
+
+// If the kernel faulted at one of the fixups, resume at its fixup
+// code and return 1.
+static int
+fixup(struct trapframe *tf)
+{
+  int i;
+
+  for(i = 0; i < NELEM(fixups); i++){
+    if(tf->eip == (uint)fixups[i].eip){
+      tf->eip = (uint)fixups[i].fixup;
+      return 1;
+    }
+  }
+  return 0;
+}
+
 //PAGEBREAK: 41
 void
 trap(struct trapframe *tf)
 {
+  uint va;
+
   if(tf->trapno == T_SYSCALL){
     if(myproc()->killed)
       exit();
     myproc()->tf = tf;
+    myproc()->inkernel++;
     syscall();
+    myproc()->inkernel--;
     if(myproc()->killed)
       exit();
     return;
@@ -53,6 +83,7 @@ trap(struct trapframe *tf)
       ticks++;
       wakeup(&ticks);
       release(&tickslock);
+      futextick();
     }
     lapiceoi();
     break;
@@ -71,6 +102,13 @@ trap(struct trapframe *tf)
     uartintr();
     lapiceoi();
     break;
+  case T_TLBFLUSH:
+    // Clear the request first: one made after this is
+    // covered by the flush or by another interrupt.
+    xchg(&mycpu()->tlbflush, 0);
+    lcr3(rcr3());
+    lapiceoi();
+    break;
   case T_IRQ0 + 7:
   case T_IRQ0 + IRQ_SPURIOUS:
     cprintf("cpu%d: spurious interrupt at %x:%x\n",
@@ -78,6 +116,26 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // Bring back a swapped-out page or fill in a page of an mmap
+    // region.  Both may sleep on the disk, so turn interrupts back
+    // on first.  The kernel only faults on user memory if it is not
+    // holding spinlocks, or in umemmove(), which then fails.
+    va = rcr2();
+    if(myproc() && va < KERNBASE &&
+       ((tf->cs&3) == DPL_USER || mycpu()->ncli == 0)){
+      myproc()->inkernel++;
+      sti();
+      if(((tf->err & FEC_PR) == 0 && swapin(myproc()->pgdir, va) == 0) ||
+         mmapfault(va, tf->err & FEC_WR) == 0){
+        myproc()->inkernel--;
+        break;
+      }
+      myproc()->inkernel--;
+    }
+    if(myproc() && va < KERNBASE && (tf->cs&3) == 0 && fixup(tf))
+      break;
+    // fall through
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -2,9 +2,42 @@
 #include "stat.h"
 #include "user.h"
 #include "param.h"
+#include "x86.h"
+#include "mman.h"
+#include "uthread.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator.
+//
+// Small blocks come in size classes.  Each class keeps free blocks
+// in a per-thread cache, refilled in batches from a central list
+// for the class, which is refilled by carving spans out of the
+// heap.  Threads that free a lot hand half their cache back to the
+// central list.
+//
+// The heap itself is the free list allocator by Kernighan and
+// Ritchie, The C programming Language, 2nd ed.  Section 8.7.  It
+// serves blocks too big for a class and gives free memory at the
+// top of the heap back with a negative sbrk().  Very large blocks
+// get their own anonymous mmap() region.
+//
+// A thread finds its cache through its thread-local storage, which
+// says which of the NCACHE caches it was handed the first time it
+// needed one.  With more threads than caches, two threads may share
+// a cache, which is why each cache still has a lock.
+
+#define PGSIZE     4096
+#define NCLASS     14
+#define MAXSMALL   2048              // largest class block size
+#define NCACHE     16
+#define BATCH      32                // blocks moved per refill
+#define CACHEMAX   (2*BATCH)         // cache size that triggers a flush
+#define SPANSIZE   (16*1024)
+#define TRIMSIZE   (128*1024)        // free heap top worth trimming
+#define MMAPSIZE   (256*1024)        // blocks this big use mmap()
+
+// Header flags in s.size for blocks not owned by the heap.
+#define SMALL      0x80000000        // low bits are the class
+#define MAPPED     0x40000000        // low bits are the region size
 
 typedef long Align;
 
@@ -18,11 +51,80 @@ union header {
 
 typedef union header Header;
 
+struct cache {
+  volatile uint lock;
+  Header *list[NCLASS];
+  int n[NCLASS];
+};
+
+static uint classsize[NCLASS] = {
+  16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+static uchar sizeclass[MAXSMALL/16 + 1];  // block size/16 -> class
+
+static struct cache caches[NCACHE];
+
+// The heap and the central class lists.
+static volatile uint heaplock;
+static Header *central[NCLASS];
 static Header base;
 static Header *freep;
+static char *heapend;                     // end of the last sbrk() chunk
 
-void
-free(void *ap)
+static void
+lock(volatile uint *l)
+{
+  int n;
+
+  for(n = 1; xchg(l, 1) != 0; n++)
+    if(n % 64 == 0)
+      yield();
+}
+
+static void
+unlock(volatile uint *l)
+{
+  xchg(l, 0);
+}
+
+static struct cache*
+mycache(void)
+{
+  static struct tls maintls;
+  static volatile int nextcache;
+  struct tls *t;
+
+  if((t = tls()) == 0){
+    // The first thread of the process has no block of its own.
+    maintls.self = &maintls;
+    set_tls(&maintls);
+    t = &maintls;
+  }
+  if(t->malloc == 0)
+    t->malloc = &caches[atomic_add(&nextcache, 1) % NCACHE];
+  return t->malloc;
+}
+
+// Give the free top of the heap back to the kernel if it is big
+// enough and nobody else moved the break.  Called with heaplock.
+static void
+trim(Header *p)
+{
+  char *cut;
+
+  if((char*)(p + p->s.size) != heapend)
+    return;
+  cut = (char*)(((uint)(p + 1) + PGSIZE-1) & ~(PGSIZE-1));
+  if(heapend - cut < TRIMSIZE || sbrk(0) != heapend)
+    return;
+  p->s.size = (cut - (char*)p) / sizeof(Header);
+  sbrk(-(heapend - cut));
+  heapend = cut;
+}
+
+// Return block ap to the heap.  Called with heaplock.
+static void
+hfree(void *ap)
 {
   Header *bp, *p;
 
@@ -54,19 +156,19 @@ morecore(uint nu)
   p = sbrk(nu * sizeof(Header));
   if(p == (char*)-1)
     return 0;
+  heapend = p + nu * sizeof(Header);
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  hfree((void*)(hp + 1));
   return freep;
 }
 
-void*
-malloc(uint nbytes)
+// Allocate nunits from the heap.  Called with heaplock.
+static Header*
+halloc(uint nunits)
 {
   Header *p, *prevp;
-  uint nunits;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -81,10 +183,142 @@ malloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
-      return (void*)(p + 1);
+      return p;
     }
     if(p == freep)
       if((p = morecore(nunits)) == 0)
         return 0;
   }
 }
+
+// Fill c's list for class k from the central list, or from a new
+// span.  Called with c->lock held.
+static void
+refill(struct cache *c, int k)
+{
+  Header *h, *span;
+  uint i, n, step;
+
+  lock(&heaplock);
+  for(n = 0; n < BATCH && (h = central[k]) != 0; n++){
+    central[k] = h->s.ptr;
+    h->s.ptr = c->list[k];
+    c->list[k] = h;
+  }
+  if(n == 0 && (span = halloc(SPANSIZE/sizeof(Header))) != 0){
+    step = classsize[k] / sizeof(Header);
+    for(i = 0; i + step <= SPANSIZE/sizeof(Header); i += step, n++){
+      h = span + i;
+      h->s.ptr = c->list[k];
+      c->list[k] = h;
+    }
+  }
+  unlock(&heaplock);
+  c->n[k] += n;
+}
+
+// Move half of c's list for class k to the central list.
+// Called with c->lock held.
+static void
+flush(struct cache *c, int k)
+{
+  Header *h;
+
+  lock(&heaplock);
+  for(; c->n[k] > CACHEMAX/2; c->n[k]--){
+    h = c->list[k];
+    c->list[k] = h->s.ptr;
+    h->s.ptr = central[k];
+    central[k] = h;
+  }
+  unlock(&heaplock);
+}
+
+static void*
+bigalloc(uint nbytes)
+{
+  Header *h;
+  uint len;
+
+  len = (nbytes + sizeof(Header) + PGSIZE-1) & ~(PGSIZE-1);
+  h = mmap(0, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(h == MAP_FAILED)
+    return 0;
+  h->s.size = MAPPED | len;
+  return (void*)(h + 1);
+}
+
+void
+free(void *ap)
+{
+  struct cache *c;
+  Header *h;
+  int k;
+
+  if(ap == 0)
+    return;
+  h = (Header*)ap - 1;
+  if(h->s.size & SMALL){
+    k = h->s.size & ~SMALL;
+    c = mycache();
+    lock(&c->lock);
+    h->s.ptr = c->list[k];
+    c->list[k] = h;
+    if(++c->n[k] > CACHEMAX)
+      flush(c, k);
+    unlock(&c->lock);
+  } else if(h->s.size & MAPPED){
+    munmap(h, h->s.size & ~MAPPED);
+  } else {
+    lock(&heaplock);
+    hfree(ap);
+    // The block ending at the break is freep or the one after it.
+    trim(freep + freep->s.size == (Header*)heapend ? freep : freep->s.ptr);
+    unlock(&heaplock);
+  }
+}
+
+void*
+malloc(uint nbytes)
+{
+  struct cache *c;
+  Header *h;
+  void *p;
+  uint n;
+  int k;
+
+  if(nbytes > 0x3FFFFFFF)
+    return 0;
+  n = nbytes + sizeof(Header);
+  if(n <= MAXSMALL){
+    if(sizeclass[MAXSMALL/16] == 0){
+      // Racing threads all write the same table.
+      for(k = 0, n = 0; n <= MAXSMALL/16; n++){
+        while(classsize[k] < n*16)
+          k++;
+        sizeclass[n] = k;
+      }
+      n = nbytes + sizeof(Header);
+    }
+    k = sizeclass[(n + 15)/16];
+    c = mycache();
+    lock(&c->lock);
+    if(c->list[k] == 0)
+      refill(c, k);
+    if((h = c->list[k]) != 0){
+      c->list[k] = h->s.ptr;
+      c->n[k]--;
+    }
+    unlock(&c->lock);
+    if(h == 0)
+      return 0;
+    h->s.size = SMALL | k;
+    return (void*)(h + 1);
+  }
+  if(n >= MMAPSIZE && (p = bigalloc(nbytes)) != 0)
+    return p;
+  lock(&heaplock);
+  h = halloc((n + sizeof(Header) - 1)/sizeof(Header));
+  unlock(&heaplock);
+  return h ? (void*)(h + 1) : 0;
+}
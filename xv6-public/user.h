@@ -1,4 +1,6 @@
 struct stat;
+struct meminfo;
+struct procmem;
 struct rtcdate;
 
 // system calls
@@ -33,6 +35,21 @@ void thread_exit(void *)__attribute__((noreturn));
 int thread_join(thread_t, void **);
 int pwrite(int, void*, int, int);
 int pread(int, void*, int, int);
+int set_superpage(int);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int shmget(int, int, int);
+void* shmat(int);
+int shmdt(void*);
+int shmrm(int);
+int meminfo(struct meminfo*, struct procmem*, int);
+int spawn(char*, char**, int*);
+int set_thread_stack(int);
+int thread_join_any(thread_t*, void**);
+int futex_wait(int*, int, int);
+int futex_wake(int*, int);
+int set_tls(void*);
+int fadvise(int, int, int, int);
 // ulib.c
 int stat(char*, struct stat*);
 char* strcpy(char*, char*);
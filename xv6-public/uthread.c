@@ -0,0 +1,161 @@
+#include "types.h"
+#include "user.h"
+#include "uthread.h"
+
+// Mutexes are the three-state futex locks of Drepper, "Futexes
+// Are Tricky": an unlock only enters the kernel if some thread
+// may be asleep on the lock.  Condition variables sleep on a
+// sequence number that every signal bumps, so a signal between
+// the unlock in cond_wait() and the sleep is not lost.  Barriers
+// and reader-writer locks are built from the two.
+
+#define SPINS 100              // tries before a mutex sleeps
+
+void
+spin_lock(struct spinlock *l)
+{
+  int n;
+
+  for(n = 1; atomic_xchg(&l->locked, 1) != 0; n++){
+    while(l->locked)
+      if(n++ % 64 == 0)
+        yield();
+  }
+}
+
+int
+spin_trylock(struct spinlock *l)
+{
+  return atomic_xchg(&l->locked, 1) == 0;
+}
+
+void
+spin_unlock(struct spinlock *l)
+{
+  atomic_xchg(&l->locked, 0);
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  int i, c;
+
+  for(i = 0; i < SPINS; i++)
+    if((c = atomic_cas(&m->state, 0, 1)) == 0)
+      return;
+  // Say there is a waiter, then sleep until the lock is free.
+  if(c != 2)
+    c = atomic_xchg(&m->state, 2);
+  while(c != 0){
+    futex_wait((int*)&m->state, 2, 0);
+    c = atomic_xchg(&m->state, 2);
+  }
+}
+
+int
+mutex_trylock(struct mutex *m)
+{
+  return atomic_cas(&m->state, 0, 1) == 0;
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(atomic_xchg(&m->state, 0) == 2)
+    futex_wake((int*)&m->state, 1);
+}
+
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq;
+
+  seq = c->seq;
+  mutex_unlock(m);
+  futex_wait((int*)&c->seq, seq, 0);
+  // Others may have been woken with us: take the lock as a
+  // waiter so that our unlock wakes the next one.
+  while(atomic_xchg(&m->state, 2) != 0)
+    futex_wait((int*)&m->state, 2, 0);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  atomic_add(&c->seq, 1);
+  futex_wake((int*)&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  atomic_add(&c->seq, 1);
+  futex_wake((int*)&c->seq, 0x7FFFFFFF);
+}
+
+void
+barrier_init(struct barrier *b, int n)
+{
+  memset(b, 0, sizeof(*b));
+  b->n = n;
+}
+
+// Wait until n threads are waiting.  Returns 1 in the last one
+// to arrive and 0 in the others.
+int
+barrier_wait(struct barrier *b)
+{
+  int phase;
+
+  mutex_lock(&b->m);
+  phase = b->phase;
+  if(++b->count == b->n){
+    b->count = 0;
+    b->phase++;
+    cond_broadcast(&b->c);
+    mutex_unlock(&b->m);
+    return 1;
+  }
+  while(phase == b->phase)
+    cond_wait(&b->c, &b->m);
+  mutex_unlock(&b->m);
+  return 0;
+}
+
+void
+rwlock_rdlock(struct rwlock *l)
+{
+  mutex_lock(&l->m);
+  while(l->writer || l->nwriterwait)
+    cond_wait(&l->readers, &l->m);
+  l->nreader++;
+  mutex_unlock(&l->m);
+}
+
+void
+rwlock_wrlock(struct rwlock *l)
+{
+  mutex_lock(&l->m);
+  l->nwriterwait++;
+  while(l->writer || l->nreader)
+    cond_wait(&l->writers, &l->m);
+  l->nwriterwait--;
+  l->writer = 1;
+  mutex_unlock(&l->m);
+}
+
+void
+rwlock_unlock(struct rwlock *l)
+{
+  mutex_lock(&l->m);
+  if(l->writer)
+    l->writer = 0;
+  else
+    l->nreader--;
+  if(l->nwriterwait){
+    if(l->nreader == 0)
+      cond_signal(&l->writers);
+  } else
+    cond_broadcast(&l->readers);
+  mutex_unlock(&l->m);
+}
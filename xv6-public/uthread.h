@@ -0,0 +1,102 @@
+// Thread synchronization for user programs, on top of
+// thread_create() and futex_wait()/futex_wake().  Include after
+// user.h.  Every object is ready to use when zeroed, except that
+// a barrier needs barrier_init().
+
+// Atomics.  Each returns the value *addr had before.
+static inline int
+atomic_xchg(volatile int *addr, int v)
+{
+  asm volatile("lock; xchgl %0, %1" : "+m" (*addr), "+r" (v) : : "memory");
+  return v;
+}
+
+static inline int
+atomic_cas(volatile int *addr, int old, int new)
+{
+  int prev;
+
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "=a" (prev), "+m" (*addr) :
+               "r" (new), "0" (old) :
+               "memory", "cc");
+  return prev;
+}
+
+static inline int
+atomic_add(volatile int *addr, int v)
+{
+  asm volatile("lock; xaddl %0, %1" : "+r" (v), "+m" (*addr) : : "memory", "cc");
+  return v;
+}
+
+// Thread-local storage.  Each thread starts with a TLSSIZE-byte
+// block at the top of its stack, and %gs:0 points at it; the first
+// thread of a process has none until it calls set_tls().
+struct tls {
+  struct tls *self;
+  void *malloc;                // umalloc.c's cache for the thread
+  void *data[14];              // free for the program
+};
+
+// The calling thread's block, or 0.
+static inline struct tls*
+tls(void)
+{
+  struct tls *t;
+  ushort gs;
+
+  asm volatile("movw %%gs, %0" : "=r" (gs));
+  if(gs == 0)
+    return 0;
+  asm volatile("movl %%gs:0, %0" : "=r" (t));
+  return t;
+}
+
+// Lock that spins, yielding now and then.
+struct spinlock {
+  volatile int locked;
+};
+
+// Lock that sleeps in the kernel only when contended.
+struct mutex {
+  volatile int state;          // 0 free, 1 locked, 2 locked with waiters
+};
+
+struct cond {
+  volatile int seq;            // bumped by every signal
+};
+
+struct barrier {
+  struct mutex m;
+  struct cond c;
+  int n;                       // threads to wait for
+  int count;                   // threads waiting now
+  int phase;
+};
+
+// Many readers or one writer; waiting writers go first.
+struct rwlock {
+  struct mutex m;
+  struct cond readers;
+  struct cond writers;
+  int nreader;
+  int writer;
+  int nwriterwait;
+};
+
+// uthread.c
+void spin_lock(struct spinlock*);
+int spin_trylock(struct spinlock*);
+void spin_unlock(struct spinlock*);
+void mutex_lock(struct mutex*);
+int mutex_trylock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+void barrier_init(struct barrier*, int);
+int barrier_wait(struct barrier*);
+void rwlock_rdlock(struct rwlock*);
+void rwlock_wrlock(struct rwlock*);
+void rwlock_unlock(struct rwlock*);
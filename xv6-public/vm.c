@@ -5,7 +5,9 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "traps.h"
 #include "elf.h"
+#include "meminfo.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -31,18 +33,21 @@ seginit(void)
 
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
-// create any required page table pages.
-static pte_t *
+// create any required page table pages.  If va lies in a
+// superpage, the PDE itself is returned (PTE_PS is set in it).
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
+  if(*pde & PTE_PS)
+    return pde;
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
+    if(!alloc || (pgtab = (pte_t*)kalloc(KM_PGTABLE)) == 0)
       return 0;
     // Make sure all those PTE_P bits are zero.
     memset(pgtab, 0, PGSIZE);
@@ -57,7 +62,7 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
-static int
+int
 mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 {
   char *a, *last;
@@ -79,6 +84,35 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
   return 0;
 }
 
+// Like mappages, but use a single superpage PDE for every
+// 4 MB-aligned 4 MB run, so big kernel mappings need no page
+// tables and fewer TLB entries.  Only used for the kernel half.
+static int
+mapsuper(pde_t *pgdir, void *va, uint size, uint pa, int perm)
+{
+  uint a, n;
+
+  a = (uint)va;
+  while(size > 0){
+    if(a % SUPERPGSIZE == 0 && pa % SUPERPGSIZE == 0 && size >= SUPERPGSIZE){
+      if(pgdir[PDX(a)] & PTE_P)
+        panic("remap");
+      pgdir[PDX(a)] = pa | perm | PTE_P | PTE_PS;
+      n = SUPERPGSIZE;
+    } else {
+      n = SUPERPGSIZE - a % SUPERPGSIZE;
+      if(n > size)
+        n = size;
+      if(mappages(pgdir, (void*)a, n, pa, perm) < 0)
+        return -1;
+    }
+    a += n;
+    pa += n;
+    size -= n;
+  }
+  return 0;
+}
+
 // There is one page table per process, plus one that's used when
 // a CPU is not running any process (kpgdir). The kernel uses the
 // current process's page table during system calls and interrupts;
@@ -92,13 +126,20 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 //   KERNBASE..KERNBASE+EXTMEM: mapped to 0..EXTMEM (for I/O space)
 //   KERNBASE+EXTMEM..data: mapped to EXTMEM..V2P(data)
 //                for the kernel's instructions and r/o data
-//   data..KERNBASE+PHYSTOP: mapped to V2P(data)..PHYSTOP,
+//   data..KERNBASE+phystop: mapped to V2P(data)..phystop,
 //                                  rw data + free physical memory
 //   0xfe000000..0: mapped direct (devices such as ioapic)
 //
 // The kernel allocates physical memory for its heap and for user memory
-// between V2P(end) and the end of physical memory (PHYSTOP)
-// (directly addressable from end..P2V(PHYSTOP)).
+// between V2P(end) and the end of physical memory (phystop)
+// (directly addressable from end..P2V(phystop)).
+//
+// Only the kernel half of kpgdir is built from kmap[].  Every other
+// page table copies kpgdir's kernel page directory entries, so all
+// address spaces share one set of kernel page tables.  Memory above
+// the first 4 MB is added to the shared map by kinit2() via kvmmap().
+// Aligned 4 MB runs of the kernel map use PSE superpages; the first
+// 4 MB keeps small pages so kernel text can stay read-only.
 
 // This table defines the kernel's mappings, which are present in
 // every process's page table.
@@ -110,7 +151,7 @@ static struct kmap {
 } kmap[] = {
  { (void*)KERNBASE, 0,             EXTMEM,    PTE_W}, // I/O space
  { (void*)KERNLINK, V2P(KERNLINK), V2P(data), 0},     // kern text+rodata
- { (void*)data,     V2P(data),     PHYSTOP,   PTE_W}, // kern data+memory
+ { (void*)data,     V2P(data),     4*1024*1024, PTE_W}, // kern data+boot memory
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
@@ -121,13 +162,18 @@ setupkvm(void)
   pde_t *pgdir;
   struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kalloc(KM_PGTABLE)) == 0)
     return 0;
   memset(pgdir, 0, PGSIZE);
+  if(kpgdir){
+    memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+            (NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
+    return pgdir;
+  }
   if (P2V(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
+    if(mapsuper(pgdir, k->virt, k->phys_end - k->phys_start,
                 (uint)k->phys_start, k->perm) < 0) {
       freevm(pgdir);
       return 0;
@@ -144,6 +190,16 @@ kvmalloc(void)
   switchkvm();
 }
 
+// Add physical memory [pa, pa+size) to the kernel's direct map.
+// Must be called before any other page table copies kpgdir.
+int
+kvmmap(uint pa, uint size)
+{
+  if(pa + size > PHYSTOP)
+    panic("kvmmap");
+  return mapsuper(kpgdir, P2V(pa), size, pa, PTE_W);
+}
+
 // Switch h/w page table register to the kernel-only page table,
 // for when no process is running.
 void
@@ -173,10 +229,45 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
+  // Loaded into %gs by trapret, if the thread has one.
+  mycpu()->gdt[SEG_UTLS] = SEG(STA_W, p->tls, 0xffffffff, DPL_USER);
   lcr3(V2P(p->pgdir));  // switch to process's address space
   popcli();
 }
 
+// Make every CPU forget the translations it cached from pgdir,
+// whose PTEs the caller has cleared, so that the pages they
+// mapped can be reused.  The other CPUs running in pgdir, threads
+// of one process, are interrupted and waited for; the rest load
+// %cr3, which flushes, before they next use it.  Caller must not
+// hold spinlocks.
+void
+tlbflush(pde_t *pgdir)
+{
+  struct cpu *c;
+  struct proc *p;
+  uint sent;
+
+  pushcli();
+  if(rcr3() == V2P(pgdir))
+    lcr3(V2P(pgdir));
+  // Order the PTE stores before the loads of c->proc.
+  __sync_synchronize();
+  sent = 0;
+  for(c = cpus; c < cpus+ncpu; c++){
+    if(c == mycpu() || (p = c->proc) == 0 || p->pgdir != pgdir)
+      continue;
+    xchg(&c->tlbflush, 1);
+    lapicipi(c->apicid, T_TLBFLUSH);
+    sent |= 1 << (c - cpus);
+  }
+  popcli();
+  for(c = cpus; c < cpus+ncpu; c++)
+    if(sent & (1 << (c - cpus)))
+      while(c->tlbflush)
+        ;
+}
+
 // Load the initcode into address 0 of pgdir.
 // sz must be less than a page.
 void
@@ -186,7 +277,7 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
+  mem = kalloc(KM_USER);
   memset(mem, 0, PGSIZE);
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
@@ -231,7 +322,7 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = swapalloc();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -248,10 +339,62 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   return newsz;
 }
 
+// Like allocuvm, but back each 4 MB-aligned 4 MB run of the new
+// region with a superpage.  Runs for which no contiguous physical
+// memory is free, and the unaligned ends, get ordinary pages.
+int
+allocsuvm(pde_t *pgdir, uint oldsz, uint newsz)
+{
+  char *mem;
+  uint a, next;
+
+  if(newsz >= KERNBASE)
+    return 0;
+  if(newsz < oldsz)
+    return oldsz;
+
+  for(a = PGROUNDUP(oldsz); a < newsz; a = next){
+    if(a % SUPERPGSIZE == 0 && a + SUPERPGSIZE <= newsz &&
+       (pgdir[PDX(a)] & PTE_P) == 0 && (mem = kallocsuper()) != 0){
+      memset(mem, 0, SUPERPGSIZE);
+      pgdir[PDX(a)] = V2P(mem) | PTE_P | PTE_W | PTE_U | PTE_PS;
+      next = a + SUPERPGSIZE;
+      continue;
+    }
+    next = SUPERPGROUNDUP(a + 1);
+    if(next > newsz)
+      next = newsz;
+    if(allocuvm(pgdir, a, next) == 0){
+      deallocuvm(pgdir, a, oldsz);
+      return 0;
+    }
+  }
+  return newsz;
+}
+
+// Replace the superpage mapped by *pde with a page table mapping
+// the same memory with 4 KB pages.  Returns -1 if out of memory.
+static int
+splitsuper(pde_t *pde)
+{
+  pte_t *pgtab;
+  uint pa, flags, i;
+
+  if((pgtab = (pte_t*)kalloc(KM_PGTABLE)) == 0)
+    return -1;
+  pa = PTE_ADDR(*pde);
+  flags = PTE_FLAGS(*pde) & ~PTE_PS;
+  for(i = 0; i < NPTENTRIES; i++)
+    pgtab[i] = (pa + i*PGSIZE) | flags;
+  *pde = V2P(pgtab) | PTE_P | PTE_W | PTE_U;
+  return 0;
+}
+
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
-// process size.  Returns the new process size.
+// process size.  Returns the new process size, or 0 if a superpage
+// that is only partly freed could not be split.
 int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
@@ -264,9 +407,23 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   a = PGROUNDUP(newsz);
   for(; a  < oldsz; a += PGSIZE){
     pte = walkpgdir(pgdir, (char*)a, 0);
+    if(pte && (*pte & PTE_PS)){
+      if(a % SUPERPGSIZE == 0 && a + SUPERPGSIZE <= oldsz){
+        kfreesuper(P2V(PTE_ADDR(*pte)));
+        *pte = 0;
+        a += SUPERPGSIZE - PGSIZE;
+        continue;
+      }
+      if(splitsuper(pte) < 0)
+        return 0;
+      pte = walkpgdir(pgdir, (char*)a, 0);
+    }
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
-    else if((*pte & PTE_P) != 0){
+    else if(*pte & PTE_SWAP){
+      swapfree(*pte);
+      *pte = 0;
+    } else if((*pte & PTE_P) != 0){
       pa = PTE_ADDR(*pte);
       if(pa == 0)
         panic("kfree");
@@ -288,7 +445,7 @@ freevm(pde_t *pgdir)
   if(pgdir == 0)
     panic("freevm: no pgdir");
   deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
+  for(i = 0; i < PDX(KERNBASE); i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
@@ -305,7 +462,7 @@ clearpteu(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if(pte == 0)
+  if(pte == 0 || (*pte & PTE_PS))
     panic("clearpteu");
   *pte &= ~PTE_U;
 }
@@ -325,11 +482,34 @@ copyuvm(pde_t *pgdir, uint sz)
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
       panic("copyuvm: pte should exist");
+    if(*pte & PTE_PS){
+      // Keep the child on a superpage if one is free.
+      if(i % SUPERPGSIZE == 0 && (mem = kallocsuper()) != 0){
+        memmove(mem, (char*)P2V(PTE_ADDR(*pte)), SUPERPGSIZE);
+        d[PDX(i)] = V2P(mem) | PTE_FLAGS(*pte);
+        i += SUPERPGSIZE - PGSIZE;
+        continue;
+      }
+      pa = PTE_ADDR(*pte) + (i & (SUPERPGSIZE-1));
+      flags = PTE_FLAGS(*pte) & ~PTE_PS;
+      goto copy;
+    }
+    if(*pte & PTE_SWAP){
+      if((mem = swapalloc()) == 0)
+        goto bad;
+      swapread(*pte, mem);
+      if(mappages(d, (void*)i, PGSIZE, V2P(mem), PTE_FLAGS(*pte) & ~PTE_SWAP) < 0){
+        kfree(mem);
+        goto bad;
+      }
+      continue;
+    }
     if(!(*pte & PTE_P))
       panic("copyuvm: page not present");
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+copy:
+    if((mem = swapalloc()) == 0)
       goto bad;
     memmove(mem, (char*)P2V(pa), PGSIZE);
     if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0)
@@ -342,6 +522,32 @@ bad:
   return 0;
 }
 
+// Count the user pages of pgdir that are resident and that are
+// swapped out.  Pages shared with other page tables count in each.
+void
+uvmcount(pde_t *pgdir, uint *rss, uint *swapped)
+{
+  pte_t *pgtab;
+  uint i, j;
+
+  *rss = *swapped = 0;
+  for(i = 0; i < PDX(KERNBASE); i++){
+    if((pgdir[i] & PTE_P) == 0)
+      continue;
+    if(pgdir[i] & PTE_PS){
+      *rss += NPTENTRIES;
+      continue;
+    }
+    pgtab = (pte_t*)P2V(PTE_ADDR(pgdir[i]));
+    for(j = 0; j < NPTENTRIES; j++){
+      if((pgtab[j] & (PTE_P|PTE_U)) == (PTE_P|PTE_U))
+        (*rss)++;
+      else if(pgtab[j] & PTE_SWAP)
+        (*swapped)++;
+    }
+  }
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -350,16 +556,19 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
+  if(*pte & PTE_PS)
+    return (char*)P2V(PTE_ADDR(*pte) + PGROUNDDOWN((uint)uva & (SUPERPGSIZE-1)));
   return (char*)P2V(PTE_ADDR(*pte));
 }
 
 // Copy len bytes from p to user address va in page table pgdir.
 // Most useful when pgdir is not the current page table.
-// uva2ka ensures this only works for PTE_U pages.
+// uva2ka ensures this only works for PTE_U pages.  p may be in
+// the current process's user memory.
 int
 copyout(pde_t *pgdir, uint va, void *p, uint len)
 {
@@ -375,7 +584,8 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
     n = PGSIZE - (va - va0);
     if(n > len)
       n = len;
-    memmove(pa0 + (va - va0), buf, n);
+    if(umemmove(pa0 + (va - va0), buf, n) < 0)
+      return -1;
     len -= n;
     buf += n;
     va = va0 + PGSIZE;